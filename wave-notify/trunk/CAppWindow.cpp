@@ -39,7 +39,9 @@ CAppWindow::CAppWindow() :
 	m_fReceivedFirstContactUpdates(FALSE),
 	m_lpAvatarRequest(NULL),
 	m_fClientSuspended(FALSE),
-	m_fClientLocked(FALSE)
+	m_fClientLocked(FALSE),
+	m_uResponseTicks(0),
+	m_lpReplay(NULL)
 {
 	
 	m_lpTimers = new CTimerCollection(this);
@@ -79,10 +81,18 @@ CAppWindow::~CAppWindow()
 
 	m_lpSession->RemoveProgressTarget(this);
 
-	delete m_lpSession;
+	if (m_lpReplay != NULL)
+	{
+		delete m_lpReplay;
+	}
+
+	// The monitor goes first; its reader thread may still be reading
+	// channel data into the session.
 
 	delete m_lpMonitor;
 
+	delete m_lpSession;
+
 	if (m_lpView != NULL)
 	{
 		delete m_lpView;
@@ -184,10 +194,19 @@ LRESULT CAppWindow::OnCreate()
 {
 	m_lpNotifyIcon->Create();
 
+#if defined(_DEBUG) && defined(TEST_CHANNEL_REPLAY)
+	// The responses of the trace are merged into the view as if they
+	// came from the channel.
+
+	m_lpView = new CWaveView();
+
+	m_lpReplay = new CWaveTraceReplay(m_lpSession, WAVE_CHANNEL_TRACE, TRUE);
+#else
 	if (!LoginFromRegistry())
 	{
 		PromptForCredentials();
 	}
+#endif
 
 	Compat_WTSRegisterSessionNotification(GetHandle(), NOTIFY_FOR_THIS_SESSION);
 	
@@ -425,7 +444,11 @@ void CAppWindow::SignOut(BOOL fManual)
 		CPopupWindow::Instance()->CancelAll();
 	}
 
-	m_lpSession->SignOut();
+	// Signing out when quitting keeps the session, so the next start
+	// can continue with it. The session logs out anyway when it could
+	// not save its state.
+
+	m_lpSession->SignOut(!fManual);
 
 	if (fManual)
 	{
@@ -531,14 +554,105 @@ void CAppWindow::ProcessSignedOut()
 {
 	m_lpNotifyIcon->SetIcon(CNotifierApp::Instance()->GetNotifyIconGray());
 
+	ReportStatistics();
+
 	if (m_fQuitting)
 	{
 		DestroyWindow();
 	}
 }
 
+void CAppWindow::ReportStatistics()
+{
+	// The statistics are appended to statistics.txt every time the
+	// session signs out. They run from the start of the application.
+
+	LARGE_INTEGER liFrequency;
+
+	QueryPerformanceFrequency(&liFrequency);
+
+	double dResponseTime = (double)m_uResponseTicks * 1000.0 / (double)liFrequency.QuadPart;
+	double dChannelMB = (double)m_lpSession->GetChannelBytes() / (1024.0 * 1024.0);
+
+	wstringstream szReport;
+
+	szReport
+		<< Format(L"UI busy time: %.1f ms for %.3f MB of channel data", dResponseTime, dChannelMB)
+		<< L"\r\n";
+
+	if (dChannelMB > 0)
+	{
+		szReport
+			<< Format(L"UI busy time per MB: %.1f ms", dResponseTime / dChannelMB)
+			<< L"\r\n";
+	}
+
+	szReport
+		<< Format(
+			L"Curl handles: %d requests, %d connects, %d pool hits, %d pool misses",
+			(INT)CCurlHandlePool::GetRequests(),
+			(INT)CCurlHandlePool::GetConnects(),
+			(INT)CCurlHandlePool::GetHits(),
+			(INT)CCurlHandlePool::GetMisses())
+		<< L"\r\n";
+
+	szReport
+		<< Format(L"Most requests queued: %u", m_lpSession->GetMaxQueuedRequests())
+		<< L"\r\n";
+
+	szReport
+		<< Format(L"Time to connect: %u ms", m_lpSession->GetConnectTime())
+		<< L"\r\n";
+
+	szReport
+		<< Format(
+			L"Channel waves: %d decoded, %d reused",
+			(INT)m_lpSession->GetChannelDecoder()->GetDecodedWaves(),
+			(INT)m_lpSession->GetChannelDecoder()->GetReusedWaves())
+		<< L"\r\n";
+
+	szReport
+		<< Format(L"Interned strings: %u", CStringPool::GetCount())
+		<< L"\r\n";
+
+	szReport
+		<< Format(
+			L"Message text: at most %u characters held, budget %u, %u waves discarded over budget",
+			CWaveView::GetMostTextHeld(),
+			CNotifierApp::Instance()->GetMessageTextBudget(),
+			CWaveView::GetWavesOverBudget())
+		<< L"\r\n";
+
+	if (m_lpSession->GetLastReconnectTime() != 0)
+	{
+		static LPCWSTR szTiers[] = { L"channel", L"SID", L"login" };
+
+		ASSERT(m_lpSession->GetLastReconnectTier() < WRT_MAX);
+
+		szReport
+			<< Format(
+				L"Last reconnect: %s, %u ms",
+				szTiers[m_lpSession->GetLastReconnectTier()],
+				m_lpSession->GetLastReconnectTime())
+			<< L"\r\n";
+	}
+
+	szReport << L"\r\n";
+
+	Log_Append(L"statistics.txt", ConvertToMultiByte(szReport.str()).c_str());
+}
+
 void CAppWindow::ProcessResponse(CWaveResponse * lpResponse)
 {
+	// The time spent here is all the UI thread spends on the channel;
+	// together with the channel bytes of the session it gives the busy
+	// time per MB of channel data. Most responses take less than a tick
+	// of GetTickCount, so the performance counter is used.
+
+	LARGE_INTEGER liStarted;
+
+	QueryPerformanceCounter(&liStarted);
+
 	if (lpResponse != NULL)
 	{
 		if (lpResponse->GetType() == WMT_GET_CONTACT_DETAILS)
@@ -546,12 +660,12 @@ void CAppWindow::ProcessResponse(CWaveResponse * lpResponse)
 			// We have received requested contact details. Update our internal map
 			// of what contacts we have received.
 
-			const TWaveContactMap & vContacts =
+			const TWaveContactVector & vContacts =
 				((CWaveResponseGetContactDetails *)lpResponse)->GetContacts()->GetContacts();
 
-			for (TWaveContactMapConstIter iter = vContacts.begin(); iter != vContacts.end(); iter++)
+			for (TWaveContactVectorConstIter iter = vContacts.begin(); iter != vContacts.end(); iter++)
 			{
-				TStringBoolMapIter pos = m_vRequestedContacts.find(iter->first);
+				TStringBoolMapIter pos = m_vRequestedContacts.find((*iter)->GetEmailAddress());
 
 				if (pos != m_vRequestedContacts.end())
 				{
@@ -614,52 +728,53 @@ void CAppWindow::ProcessResponse(CWaveResponse * lpResponse)
 
 		delete lpResponse;
 	}
+
+	LARGE_INTEGER liFinished;
+
+	QueryPerformanceCounter(&liFinished);
+
+	m_uResponseTicks += (ULONGLONG)(liFinished.QuadPart - liStarted.QuadPart);
 }
 
 void CAppWindow::DisplayWavePopups(BOOL fManual)
 {
 	ASSERT(m_lpView != NULL);
 
+	// Only the waves that changed since the last time are compared. A
+	// new view or a manual check compares the whole view.
+
+	const TStringBoolMap * lpChanges =
+		fManual || m_lpView->GetAllChanged() ? NULL : &m_lpView->GetChanges();
+
 	// Create a changelog of the current view and the last
 	// reported view.
 
 	CUnreadWaveCollection * lpUnreads = CUnreadWaveCollection::CreateUnreadWaves(
-		m_lpReportedView, m_lpView->GetWaves());
+		m_lpReportedView, m_lpView->GetWaves(), lpChanges);
 
 	// Synchronize the changelog with the queued popups.
 
-	SynchronisePopups(lpUnreads, fManual);
+	SynchronisePopups(lpUnreads, fManual, lpChanges);
 
 	// Remove all waves from the last reported that does
 	// not appear in the current view.
 
-	TruncateLastReported();
+	TruncateLastReported(lpChanges);
 
 	// Update the notify icon.
 
-	BOOL fHaveUnread = FALSE;
-
-	const TWaveMap & vWaves = m_lpView->GetWaves()->GetWaves();
-
-	for (TWaveMapConstIter iter = vWaves.begin(); iter != vWaves.end(); iter++)
-	{
-		if (iter->second->GetUnreadMessages() > 0)
-		{
-			fHaveUnread = TRUE;
-			break;
-		}
-	}
-
 	m_lpNotifyIcon->SetIcon(
-		fHaveUnread ?
+		m_lpView->GetUnreadWaves() > 0 ?
 		CNotifierApp::Instance()->GetNotifyIconUnread() :
 		CNotifierApp::Instance()->GetNotifyIcon()
 	);
 
+	m_lpView->ClearChanges();
+
 	delete lpUnreads;
 }
 
-void CAppWindow::TruncateLastReported()
+void CAppWindow::TruncateLastReported(const TStringBoolMap * lpChanges)
 {
 	ASSERT(m_lpView != NULL);
 
@@ -667,18 +782,35 @@ void CAppWindow::TruncateLastReported()
 	const TWaveMap & vCurrent = m_lpView->GetWaves()->GetWaves();
 	TStringVector vRemove;
 
-	for (TWaveMapConstIter iter = vReported.begin(); iter != vReported.end(); iter++)
+	// A wave can only have left the view when it has changed.
+
+	if (lpChanges == NULL)
 	{
-		if (vCurrent.find(iter->first) == vCurrent.end())
+		for (TWaveMapConstIter iter = vReported.begin(); iter != vReported.end(); iter++)
 		{
-			vRemove.push_back(iter->first);
+			if (vCurrent.find(iter->first) == vCurrent.end())
+			{
+				vRemove.push_back(iter->first);
+			}
+		}
+	}
+	else
+	{
+		for (TStringBoolMapConstIter iter = lpChanges->begin(); iter != lpChanges->end(); iter++)
+		{
+			if (
+				vCurrent.find(iter->first) == vCurrent.end() &&
+				vReported.find(iter->first) != vReported.end()
+			) {
+				vRemove.push_back(iter->first);
+			}
 		}
 	}
 
 	m_lpReportedView->RemoveWaves(vRemove);
 }
 
-void CAppWindow::SynchronisePopups(CUnreadWaveCollection * lpUnreads, BOOL fManual)
+void CAppWindow::SynchronisePopups(CUnreadWaveCollection * lpUnreads, BOOL fManual, const TStringBoolMap * lpChanges)
 {
 	ASSERT(lpUnreads != NULL);
 
@@ -702,9 +834,13 @@ void CAppWindow::SynchronisePopups(CUnreadWaveCollection * lpUnreads, BOOL fManu
 
 				if (lpNewUnreadWave == NULL)
 				{
-					// Cancel the popup if it isn't changed anymore.
+					// Cancel the popup if it isn't changed anymore. The
+					// popup of a wave that was not compared stays.
 
-					vMustCancel.push_back(lpPopup);
+					if (lpChanges == NULL || lpChanges->find(szPopupWaveId) != lpChanges->end())
+					{
+						vMustCancel.push_back(lpPopup);
+					}
 				}
 				else
 				{
@@ -935,15 +1071,23 @@ void CAppWindow::HaveReportedWave(wstring szWaveID)
 
 	ASSERT(m_lpView != NULL);
 
-	TWaveMap vWaves = m_lpView->GetWaves()->GetWaves();
+	const TWaveMap & vWaves = m_lpView->GetWaves()->GetWaves();
 
-	TWaveMapIter pos = vWaves.find(szWaveID);
+	TWaveMapConstIter pos = vWaves.find(szWaveID);
 
 	if (pos != vWaves.end())
 	{
-		CWave * lpWave = new CWave(*pos->second);
+		// Waves are not changed once they have been received, so the
+		// reported view shares the wave with the current view.
 
-		m_lpReportedView->AddWave(lpWave);
+		pos->second->AddRef();
+
+		m_lpReportedView->AddWave(pos->second);
+
+		// The reported view of the wave changed, so it must be compared
+		// again.
+
+		m_lpView->SetChanged(szWaveID);
 	}
 
 	if (m_vReportedTimes.find(szWaveID) == m_vReportedTimes.end())
@@ -953,7 +1097,7 @@ void CAppWindow::HaveReportedWave(wstring szWaveID)
 }
 
 
-CWaveContact * CAppWindow::GetWaveContact(wstring szEmailAddress)
+CWaveContact * CAppWindow::GetWaveContact(const wstring & szEmailAddress)
 {
 	if (m_lpView == NULL)
 	{
@@ -1094,9 +1238,6 @@ LRESULT CAppWindow::OnCurlResponse(CURL_RESPONSE nState, LPARAM lParam)
 
 	switch (nState)
 	{
-	case CR_DATA_RECEIVED:
-		return ProcessCurlDataReceived((LPCURL_DATA_RECEIVED)lParam);
-
 	case CR_COMPLETED:
 		return ProcessCurlCompleted((CCurl *)lParam);
 
@@ -1106,13 +1247,6 @@ LRESULT CAppWindow::OnCurlResponse(CURL_RESPONSE nState, LPARAM lParam)
 	}
 }
 
-LRESULT CAppWindow::ProcessCurlDataReceived(LPCURL_DATA_RECEIVED lpParam)
-{
-	ASSERT(lpParam != NULL);
-
-	return lpParam->lpReader->Read(lpParam->lpData, lpParam->cbData);
-}
-
 LRESULT CAppWindow::ProcessCurlCompleted(CCurl * lpCurl)
 {
 	ASSERT(lpCurl != NULL);
@@ -1286,17 +1420,7 @@ void CAppWindow::SeedAvatars()
 
 	ASSERT(m_lpView != NULL);
 
-	const TWaveContactMap & vContacts = m_lpView->GetContacts()->GetContacts();
-	CWaveContact * lpContact = NULL;
-
-	for (TWaveContactMapConstIter iter = vContacts.begin(); iter != vContacts.end(); iter++)
-	{
-		if (!iter->second->GetRequestedAvatar())
-		{
-			lpContact = iter->second;
-			break;
-		}
-	}
+	CWaveContact * lpContact = m_lpView->GetContacts()->GetNeedsAvatar();
 
 	if (lpContact == NULL)
 	{
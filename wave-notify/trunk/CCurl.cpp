@@ -26,11 +26,13 @@ CCurl::CCurl(wstring szUrl, CWindowHandle * lpTargetWindow)
 
 	m_lpTargetWindow = lpTargetWindow;
 
-	m_nResult = CURLE_OK;
+	m_nResult = CURL_RESULT_PENDING;
 
-	/* Initialize CURL */
+	m_szUrl = _strdup(ConvertToMultiByte(szUrl).c_str());
+
+	/* Initialize CURL; a pooled handle keeps its connection to the host open */
 
-	m_lpCurl = curl_easy_init();
+	m_lpCurl = CCurlHandlePool::Acquire(m_szUrl);
 
 	ASSERT(m_lpCurl != NULL);
 
@@ -38,8 +40,6 @@ CCurl::CCurl(wstring szUrl, CWindowHandle * lpTargetWindow)
 
 	/* Set the URL */
 
-	m_szUrl = _strdup(ConvertToMultiByte(szUrl).c_str());
-
 	curl_easy_setopt(m_lpCurl, CURLOPT_URL, m_szUrl);
 
 	/* Set the error buffer */
@@ -72,6 +72,9 @@ CCurl::CCurl(wstring szUrl, CWindowHandle * lpTargetWindow)
 	m_fIgnoreSSLErrors = FALSE;
 	m_nTimeout = -1;
 	m_fAutoRedirect = FALSE;
+	m_lpReaderThread = NULL;
+	m_lReadFailed = FALSE;
+	m_lCancelled = FALSE;
 
 	m_szProxyHost = NULL;
 	m_fProxyAuthenticated = FALSE;
@@ -101,26 +104,15 @@ CCurl::CCurl(wstring szUrl, CWindowHandle * lpTargetWindow)
 			curl_easy_setopt(m_lpCurl, CURLOPT_PROXYUSERPWD, m_szProxyUsername);
 		}
 	}
-
-	/*
-	// TODO: When this is nessesary, cleanup the slist. wave.google.com does not
-	// seem to keep the connection open though. Check when the connection is closed
-	// (see curl-log.txt) and verify whether it is possible to implement the
-	// connection to google wave in such a way that the connections are re-used.
-	CURLcode nResult = curl_easy_setopt(
-		m_lpCurl,
-		CURLOPT_HTTPHEADER,
-		curl_slist_append(
-			curl_slist_append(NULL, "Connection: keep-alive"),
-			"Keep-Alive: 300"
-		)
-	);
-	*/
 }
 
 CCurl::~CCurl()
 {
-	curl_easy_cleanup(m_lpCurl);
+	// Only the handle of a transfer that ran to its end is reused. Failed,
+	// timed out and cancelled transfers, and requests that never completed,
+	// may have left the connection halfway a response.
+
+	CCurlHandlePool::Release(m_lpCurl, m_szUrl, m_nResult == CURLE_OK);
 
 	if (m_szUserAgent != NULL)
 	{
@@ -221,25 +213,19 @@ size_t CCurl::WriteData(void * lpData, size_t dwSize, size_t dwBlocks)
 
 	if (m_lpReader != NULL && dwSize * dwBlocks > 0)
 	{
-		ASSERT(lpData != NULL);
-
-		CURL_DATA_RECEIVED cdr;
-
-		memset(&cdr, 0, sizeof(CURL_DATA_RECEIVED));
+		ASSERT(lpData != NULL && m_lpReaderThread != NULL);
 
-		cdr.lpReader = m_lpReader;
-		cdr.lpData = (LPBYTE)lpData;
-		cdr.cbData = (DWORD)(dwSize * dwBlocks);
+		// The reader runs on the reader thread, so a failing reader is
+		// only noticed on the next chunk. Returning less than we were
+		// given aborts the transfer, which is also done once the request
+		// has been cancelled.
 
-		BOOL fResult = m_lpTargetWindow->SendMessage(
-			WM_CURL_RESPONSE,
-			CR_DATA_RECEIVED,
-			(LPARAM)&cdr);
-
-		if (!fResult)
+		if (m_lReadFailed || m_lCancelled)
 		{
 			return 0;
 		}
+
+		m_lpReaderThread->QueueData(this, (LPBYTE)lpData, (DWORD)(dwSize * dwBlocks));
 	}
 
 	return dwSize * dwBlocks;
@@ -284,7 +270,7 @@ void CCurl::SignalCompleted(CURLcode nCode, LONG lStatus)
 	m_nResult = nCode;
 	m_lStatus = lStatus;
 
-	if (m_nResult != CURLE_OK && m_nResult != -1)
+	if (m_nResult != CURLE_OK && m_nResult != CURL_RESULT_CANCELLED)
 	{
 		LOG4("cURL error: %s (%d) - %d - %s", m_szError, (int)m_nResult, (int)m_lStatus, m_szUrl);
 	}
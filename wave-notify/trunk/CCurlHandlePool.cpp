@@ -0,0 +1,194 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "include.h"
+
+CLock CCurlHandlePool::m_vLock;
+CCurlHandlePool::THandleVector CCurlHandlePool::m_vHandles;
+volatile LONG CCurlHandlePool::m_lRequests = 0;
+volatile LONG CCurlHandlePool::m_lConnects = 0;
+volatile LONG CCurlHandlePool::m_lHits = 0;
+volatile LONG CCurlHandlePool::m_lMisses = 0;
+
+CURL * CCurlHandlePool::Acquire(const char * szUrl)
+{
+	ASSERT(szUrl != NULL);
+
+	// The connection cache of this version of curl belongs to the easy
+	// handle, so a connection can only be reused by taking a handle
+	// that has been to the same host. The most recently released
+	// handle is taken because its connection is the least likely to
+	// have been closed by the server.
+
+	string szHost = GetHost(szUrl);
+	CURL * lpCurl = NULL;
+
+	m_vLock.Enter();
+
+	Expire(GetTickCount());
+
+	for (THandleVectorIter iter = m_vHandles.end(); iter != m_vHandles.begin(); )
+	{
+		iter--;
+
+		if (iter->szHost == szHost)
+		{
+			lpCurl = iter->lpCurl;
+
+			m_vHandles.erase(iter);
+
+			break;
+		}
+	}
+
+	m_vLock.Leave();
+
+	// A hit starts the request with the connections and SSL sessions
+	// an earlier request left with the handle.
+
+	if (lpCurl == NULL)
+	{
+		InterlockedIncrement(&m_lMisses);
+
+		lpCurl = curl_easy_init();
+	}
+	else
+	{
+		InterlockedIncrement(&m_lHits);
+	}
+
+	return lpCurl;
+}
+
+void CCurlHandlePool::Release(CURL * lpCurl, const char * szUrl, BOOL fReusable)
+{
+	ASSERT(lpCurl != NULL && szUrl != NULL);
+
+	long lConnects;
+
+	if (curl_easy_getinfo(lpCurl, CURLINFO_NUM_CONNECTS, &lConnects) == CURLE_OK)
+	{
+		InterlockedIncrement(&m_lRequests);
+		InterlockedExchangeAdd(&m_lConnects, lConnects);
+	}
+
+	// A request that failed or was cancelled may have left its connection
+	// halfway a response, so that handle is not reused.
+
+	if (!fReusable)
+	{
+		curl_easy_cleanup(lpCurl);
+		return;
+	}
+
+	// Resetting the handle keeps its connections and SSL sessions, but
+	// also its cookies. These are cleared so the next request only
+	// sends the cookies it was given.
+
+	curl_easy_reset(lpCurl);
+	curl_easy_setopt(lpCurl, CURLOPT_COOKIELIST, "ALL");
+
+	CURL_POOL_HANDLE vHandle;
+
+	vHandle.lpCurl = lpCurl;
+	vHandle.szHost = GetHost(szUrl);
+	vHandle.dwReleased = GetTickCount();
+
+	m_vLock.Enter();
+
+	Expire(vHandle.dwReleased);
+
+	INT nIdle = 0;
+
+	for (THandleVectorConstIter iter = m_vHandles.begin(); iter != m_vHandles.end(); iter++)
+	{
+		if (iter->szHost == vHandle.szHost)
+		{
+			nIdle++;
+		}
+	}
+
+	if (nIdle < CURL_POOL_MAX_IDLE)
+	{
+		m_vHandles.push_back(vHandle);
+
+		lpCurl = NULL;
+	}
+
+	m_vLock.Leave();
+
+	if (lpCurl != NULL)
+	{
+		curl_easy_cleanup(lpCurl);
+	}
+}
+
+void CCurlHandlePool::Clear()
+{
+	m_vLock.Enter();
+
+	for (THandleVectorIter iter = m_vHandles.begin(); iter != m_vHandles.end(); iter++)
+	{
+		curl_easy_cleanup(iter->lpCurl);
+	}
+
+	m_vHandles.clear();
+
+	m_vLock.Leave();
+}
+
+string CCurlHandlePool::GetHost(const char * szUrl)
+{
+	ASSERT(szUrl != NULL);
+
+	// The host is the scheme, host and port of the URL; the handles
+	// are pooled per host.
+
+	const char * szStart = strstr(szUrl, "://");
+
+	if (szStart == NULL)
+	{
+		return szUrl;
+	}
+
+	const char * szEnd = strchr(szStart + 3, '/');
+
+	if (szEnd == NULL)
+	{
+		return szUrl;
+	}
+
+	return string(szUrl, szEnd - szUrl);
+}
+
+void CCurlHandlePool::Expire(DWORD dwNow)
+{
+	// Handles are appended when they are released, so the ones that
+	// have been idle the longest are at the front.
+
+	THandleVectorIter iter = m_vHandles.begin();
+
+	while (iter != m_vHandles.end() && dwNow - iter->dwReleased > CURL_POOL_IDLE_TIMEOUT)
+	{
+		curl_easy_cleanup(iter->lpCurl);
+
+		iter++;
+	}
+
+	m_vHandles.erase(m_vHandles.begin(), iter);
+}
@@ -57,14 +57,12 @@ DWORD CCurlMonitor::ThreadProc()
 
 		if (m_lpMulti->GetRunning() > 0)
 		{
-			CEvent * lpEvent = m_lpMulti->GetEvent();
+			CEvent * lpEvent = m_lpMulti->UpdateEvent();
 
 			HANDLE vHandles[2] = { m_vEvent.GetHandle(), lpEvent->GetHandle() };
 
 			dwResult = WaitForMultipleObjectsEx(
 				_ARRAYSIZE(vHandles), vHandles, FALSE, CURL_WAIT_TIMEOUT, TRUE);
-
-			delete lpEvent;
 		}
 		else
 		{
@@ -138,7 +136,7 @@ void CCurlMonitor::ProcessEvent()
 				// If we have a request to both queue and cancel, immediately
 				// set it to completed.
 
-				SignalCompleted(*pos, (CURLcode)-1, 0);
+				SignalCompleted(*pos, CURL_RESULT_CANCELLED, 0);
 
 				vQueueRequests.erase(pos);
 			}
@@ -208,13 +206,14 @@ void CCurlMonitor::ProcessMessages()
 			continue;
 		}
 
-		// Get the status.
+		// Get the status. The result of the transfer itself is what the
+		// request is completed with.
 
-		long lStatus;
+		long lStatus = 0;
 
-		nCode = curl_easy_getinfo(lpCurlHandle, CURLINFO_RESPONSE_CODE, &lStatus);
+		CURLcode nInfoCode = curl_easy_getinfo(lpCurlHandle, CURLINFO_RESPONSE_CODE, &lStatus);
 
-		CHECK(nCode == CURLE_OK);
+		CHECK(nInfoCode == CURLE_OK);
 
 		// Process the result from the message.
 
@@ -230,6 +229,8 @@ void CCurlMonitor::QueueRequests(TCurlVector & vRequests)
 
 		m_vCache.Add(*iter);
 
+		(*iter)->m_lpReaderThread = &m_vReaderThread;
+
 		m_lpMulti->Add(*iter);
 
 		m_vRequests.push_back(*iter);
@@ -244,7 +245,7 @@ void CCurlMonitor::CancelRequests(TCurlVector & vRequests)
 
 		m_lpMulti->Remove(*iter);
 
-		SignalCompleted(*iter, (CURLcode)-1, 0);
+		SignalCompleted(*iter, CURL_RESULT_CANCELLED, 0);
 	}
 
 	vRequests.clear();
@@ -255,6 +256,9 @@ void CCurlMonitor::SignalCompleted(CCurl * lpCurl, CURLcode nCode, LONG lStatus)
 	ASSERT(lpCurl != NULL);
 
 	m_vCache.Remove(lpCurl);
-	
-	lpCurl->SignalCompleted(nCode, lStatus);
+
+	// The completion goes through the reader thread so it is signalled
+	// after all data of the request has been read.
+
+	m_vReaderThread.QueueCompleted(lpCurl, nCode, lStatus);
 }
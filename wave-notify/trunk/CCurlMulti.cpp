@@ -18,7 +18,7 @@
 #include "stdafx.h"
 #include "include.h"
 
-CWSAEvent * CCurlMulti::GetEvent()
+CWSAEvent * CCurlMulti::UpdateEvent()
 {
 	fd_set rd, wr, exec;
 	int max_fd = 0;
@@ -33,40 +33,92 @@ CWSAEvent * CCurlMulti::GetEvent()
 	}
 
 	// Finding out what sockets must be set with what network event is done through
-	// a map because we cannot do two subsequent calls to WSAEventSelect with
+	// a sorted vector because we cannot do two subsequent calls to WSAEventSelect with
 	// the two network events. This must be done in one call with the network
 	// events or'red. The sockets and network events are gathered here and
-	// added to the event lateron.
+	// compared with the sockets that are already selected on the event.
 
-	TSocketMap vSockets;
+	m_vPending.clear();
 
-	AddSockets(vSockets, rd, FD_READ);
-	AddSockets(vSockets, wr, FD_WRITE);
+	AddSockets(m_vPending, rd, FD_READ);
+	AddSockets(m_vPending, wr, FD_WRITE);
 
-	CWSAEvent * lpEvent = new CWSAEvent();
+	sort(m_vPending.begin(), m_vPending.end(), CompareSockets);
+
+	TSocketVectorIter iter = m_vPending.begin();
+
+	for (TSocketVectorIter iter1 = m_vPending.begin(); iter1 != m_vPending.end(); iter1++)
+	{
+		if (iter != m_vPending.begin() && (iter - 1)->hSocket == iter1->hSocket)
+		{
+			(iter - 1)->nEvents |= iter1->nEvents;
+		}
+		else
+		{
+			*iter++ = *iter1;
+		}
+	}
+
+	m_vPending.erase(iter, m_vPending.end());
 
 	// Exec is completely ignored?!? Verified and should be OK.
 
-	for (TSocketMapIter iter = vSockets.begin(); iter != vSockets.end(); iter++)
+	// The event lives as long as the multi, so only sockets that are new
+	// or want other network events are selected again. curl does not tell us
+	// when it closes a socket, and a new socket may get the handle of a
+	// closed one. Adding or removing a request is where that mostly
+	// happens, so everything is selected again after that. The wait in
+	// the monitor has a timeout for the rest.
+
+	TSocketVectorConstIter iter2 = m_vSockets.begin();
+
+	for (TSocketVectorConstIter iter3 = m_vPending.begin(); iter3 != m_vPending.end(); iter3++)
 	{
-		ASSERT(iter->first != NULL);
+		ASSERT(iter3->hSocket != NULL);
 
-		lpEvent->EventSelect(iter->first, iter->second);
+		while (iter2 != m_vSockets.end() && iter2->hSocket < iter3->hSocket)
+		{
+			m_vEvent.EventDeselect(iter2->hSocket);
+			iter2++;
+		}
+
+		if (iter2 != m_vSockets.end() && iter2->hSocket == iter3->hSocket)
+		{
+			if (m_fReselect || iter2->nEvents != iter3->nEvents)
+			{
+				m_vEvent.EventSelect(iter3->hSocket, iter3->nEvents);
+			}
+
+			iter2++;
+		}
+		else
+		{
+			m_vEvent.EventSelect(iter3->hSocket, iter3->nEvents);
+		}
+	}
+
+	for (; iter2 != m_vSockets.end(); iter2++)
+	{
+		m_vEvent.EventDeselect(iter2->hSocket);
 	}
 
-	return lpEvent;
+	m_vSockets.swap(m_vPending);
+
+	m_fReselect = FALSE;
+
+	return &m_vEvent;
 }
 
-void CCurlMulti::AddSockets(TSocketMap & vSockets, fd_set & vSet, INT nEventType)
+void CCurlMulti::AddSockets(TSocketVector & vSockets, fd_set & vSet, INT nEventType)
 {
 	for (DWORD i = 0; i < vSet.fd_count; i++)
 	{
-		if (vSockets.find(vSet.fd_array[i]) == vSockets.end())
-		{
-			vSockets[vSet.fd_array[i]] = 0;
-		}
+		CURL_SOCKET vSocket;
 
-		vSockets[vSet.fd_array[i]] |= nEventType;
+		vSocket.hSocket = vSet.fd_array[i];
+		vSocket.nEvents = nEventType;
+
+		vSockets.push_back(vSocket);
 	}
 }
 
@@ -74,6 +126,11 @@ void CCurlMulti::Perform()
 {
 	CURLMcode nResult;
 
+	// The event stays signalled until it is reset. Anything that comes in
+	// after this is handled by this perform, or signals the event again.
+
+	m_vEvent.Reset();
+
 	while (( nResult = curl_multi_perform(m_lpMulti, &m_nRunning) ) == CURLM_CALL_MULTI_PERFORM)
 		;
 
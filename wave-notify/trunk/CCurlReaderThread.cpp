@@ -0,0 +1,195 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "include.h"
+
+CCurlReaderThread::CCurlReaderThread() : CThread(TRUE)
+{
+	m_fStopping = FALSE;
+	m_lpChunks = NULL;
+	m_lQueued = 0;
+
+	Resume();
+}
+
+CCurlReaderThread::~CCurlReaderThread()
+{
+	// Everything that was queued before stopping is still read, so
+	// the completions of the requests are signalled.
+
+	m_fStopping = TRUE;
+	m_vEvent.Set();
+
+	Join();
+}
+
+void CCurlReaderThread::QueueData(CCurl * lpCurl, LPBYTE lpData, DWORD cbData)
+{
+	ASSERT(lpCurl != NULL && lpData != NULL && cbData > 0);
+
+	// curl reuses its buffer after the write callback returns, so the
+	// data is copied into the chunk.
+
+	LPCURL_CHUNK lpChunk = (LPCURL_CHUNK)malloc(sizeof(CURL_CHUNK) + cbData);
+
+	memset(lpChunk, 0, sizeof(CURL_CHUNK));
+
+	lpChunk->nType = CCT_DATA;
+	lpChunk->lpCurl = lpCurl;
+	lpChunk->lpReader = lpCurl->GetReader();
+	lpChunk->cbData = cbData;
+	lpChunk->lpData = (LPBYTE)(lpChunk + 1);
+
+	memcpy(lpChunk->lpData, lpData, cbData);
+
+	QueueChunk(lpChunk);
+
+	// Hold the curl thread when the reader thread falls behind too far.
+
+	if (InterlockedExchangeAdd(&m_lQueued, (LONG)cbData) + (LONG)cbData > CURL_READER_QUEUE_LIMIT)
+	{
+		while (m_lQueued > CURL_READER_QUEUE_LIMIT)
+		{
+			WaitForSingleObject(m_vDrainedEvent.GetHandle(), CURL_WAIT_TIMEOUT);
+		}
+	}
+}
+
+void CCurlReaderThread::QueueCompleted(CCurl * lpCurl, CURLcode nCode, LONG lStatus)
+{
+	ASSERT(lpCurl != NULL);
+
+	LPCURL_CHUNK lpChunk = (LPCURL_CHUNK)malloc(sizeof(CURL_CHUNK));
+
+	memset(lpChunk, 0, sizeof(CURL_CHUNK));
+
+	lpChunk->nType = CCT_COMPLETED;
+	lpChunk->lpCurl = lpCurl;
+	lpChunk->nCode = nCode;
+	lpChunk->lStatus = lStatus;
+
+	QueueChunk(lpChunk);
+}
+
+void CCurlReaderThread::QueueChunk(LPCURL_CHUNK lpChunk)
+{
+	// The chunks are pushed onto a list without taking a lock. Only the
+	// chunk that finds the list empty wakes up the reader thread; chunks
+	// that arrive before it gets to the list are taken in the same batch.
+
+	LPCURL_CHUNK lpHead;
+
+	do
+	{
+		lpHead = m_lpChunks;
+		lpChunk->lpNext = lpHead;
+	}
+	while (InterlockedCompareExchangePointer((PVOID volatile *)&m_lpChunks, lpChunk, lpHead) != lpHead);
+
+	if (lpHead == NULL)
+	{
+		m_vEvent.Set();
+	}
+}
+
+LPCURL_CHUNK CCurlReaderThread::TakeChunks()
+{
+	LPCURL_CHUNK lpChunks = (LPCURL_CHUNK)InterlockedExchangePointer((PVOID volatile *)&m_lpChunks, NULL);
+
+	// The list was built newest first; reverse it to read the chunks
+	// in the order they were received.
+
+	LPCURL_CHUNK lpResult = NULL;
+
+	while (lpChunks != NULL)
+	{
+		LPCURL_CHUNK lpNext = lpChunks->lpNext;
+
+		lpChunks->lpNext = lpResult;
+		lpResult = lpChunks;
+
+		lpChunks = lpNext;
+	}
+
+	return lpResult;
+}
+
+DWORD CCurlReaderThread::ThreadProc()
+{
+	for (;;)
+	{
+		LPCURL_CHUNK lpChunks = TakeChunks();
+
+		if (lpChunks != NULL)
+		{
+			ProcessChunks(lpChunks);
+		}
+		else if (m_fStopping)
+		{
+			break;
+		}
+		else if (WaitForSingleObject(m_vEvent.GetHandle(), INFINITE) == WAIT_FAILED)
+		{
+			LOG("Wait failed");
+			break;
+		}
+	}
+
+	return 0;
+}
+
+void CCurlReaderThread::ProcessChunks(LPCURL_CHUNK lpChunks)
+{
+	LONG cbProcessed = 0;
+
+	while (lpChunks != NULL)
+	{
+		LPCURL_CHUNK lpChunk = lpChunks;
+
+		lpChunks = lpChunk->lpNext;
+
+		switch (lpChunk->nType)
+		{
+		case CCT_DATA:
+			// Once a reader has failed or the request has been cancelled,
+			// the rest of the data of the request is dropped.
+
+			if (!lpChunk->lpCurl->m_lReadFailed && !lpChunk->lpCurl->m_lCancelled)
+			{
+				if (!lpChunk->lpReader->Read(lpChunk->lpData, lpChunk->cbData))
+				{
+					InterlockedExchange(&lpChunk->lpCurl->m_lReadFailed, TRUE);
+				}
+			}
+
+			cbProcessed += (LONG)lpChunk->cbData;
+			break;
+
+		case CCT_COMPLETED:
+			lpChunk->lpCurl->SignalCompleted(lpChunk->nCode, lpChunk->lStatus);
+			break;
+		}
+
+		free(lpChunk);
+	}
+
+	if (cbProcessed > 0 && InterlockedExchangeAdd(&m_lQueued, -cbProcessed) > CURL_READER_QUEUE_LIMIT)
+	{
+		m_vDrainedEvent.Set();
+	}
+}
@@ -64,6 +64,14 @@ CNotifierApp::CNotifierApp(HINSTANCE hInstance, wstring szCmdLine) :
 		m_fNotificationWhenOnline = TRUE;
 	}
 
+	// The message text budget has no option in the UI; it can only be
+	// changed in the registry.
+
+	if (!vSettings.GetMessageTextBudget(m_dwMessageTextBudget) || m_dwMessageTextBudget == 0)
+	{
+		m_dwMessageTextBudget = WAVE_MESSAGE_TEXT_BUDGET;
+	}
+
 	if (!vSettings.GetBrowser(m_szBrowser))
 	{
 		m_szBrowser = CBrowser::BrowserDefault;
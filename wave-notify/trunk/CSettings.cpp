@@ -39,3 +39,5 @@ const wstring CSettings::RegPlaySoundOnNewWave(L"PlaySoundOnNewWave");
 const wstring CSettings::RegBrowser(L"Browser");
 const wstring CSettings::RegNotificationWhenOnline(L"NotificationWhenOnline");
 const wstring CSettings::RegApplicationRunning(L"ApplicationRunning");
+const wstring CSettings::RegMessageTextBudget(L"MessageTextBudget");
+const wstring CSettings::RegSessionState(L"SessionState");
@@ -0,0 +1,85 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "include.h"
+
+CLock CStringPool::m_vLock;
+TInternedMap CStringPool::m_vStrings;
+const wstring CStringPool::m_szEmpty;
+
+LPCINTERNED CStringPool::Intern(const wstring & szString)
+{
+	// Every distinct string is stored once for as long as it is
+	// interned. The nodes of a map do not move, so the address of the
+	// string is a handle that can be compared instead of the string.
+	// Strings are interned from the reader thread and the UI thread.
+
+	if (szString.empty())
+	{
+		return &m_szEmpty;
+	}
+
+	m_vLock.Enter();
+
+	TInternedMapIter pos = m_vStrings.insert(TInternedMap::value_type(szString, 0)).first;
+
+	pos->second++;
+
+	LPCINTERNED lpResult = &pos->first;
+
+	m_vLock.Leave();
+
+	return lpResult;
+}
+
+void CStringPool::Release(LPCINTERNED lpString)
+{
+	ASSERT(lpString != NULL);
+
+	// Every Intern is matched by a Release. The string is removed from
+	// the pool when its last handle is released.
+
+	if (lpString == &m_szEmpty)
+	{
+		return;
+	}
+
+	m_vLock.Enter();
+
+	TInternedMapIter pos = m_vStrings.find(*lpString);
+
+	ASSERT(pos != m_vStrings.end() && &pos->first == lpString && pos->second > 0);
+
+	if (--pos->second == 0)
+	{
+		m_vStrings.erase(pos);
+	}
+
+	m_vLock.Leave();
+}
+
+UINT CStringPool::GetCount()
+{
+	m_vLock.Enter();
+
+	UINT uResult = m_vStrings.size();
+
+	m_vLock.Leave();
+
+	return uResult;
+}
@@ -25,13 +25,16 @@ CUnreadWave::CUnreadWave(CWave * lpWave, CWaveMessage * lpMessage)
 {
 	ASSERT(lpWave != NULL && lpMessage != NULL);
 
-	m_szId = lpWave->GetID();
-	m_szContact = lpMessage->GetEmailAddress();
-	m_szSubject = lpWave->GetSubject();
+	// The wave is shared with the view it came from; the message is
+	// owned by the wave. The view may discard the text of the wave to
+	// stay within its budget, so the body is copied.
+
+	lpWave->AddRef();
+
+	m_lpWave = lpWave;
+	m_lpMessage = lpMessage;
 	m_szBody = lpMessage->GetText();
-	m_uUnread = lpWave->GetUnreadMessages();
-	m_dtTime = lpWave->GetTime();
-	m_lpContact = CNotifierApp::Instance()->GetWaveContact(m_szContact);
+	m_lpContact = CNotifierApp::Instance()->GetWaveContact(GetContact());
 }
 
 INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExcludeCloseButton) const
@@ -44,7 +47,7 @@ INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExclude
 	CHECK_HANDLE(hUnderlineFont);
 	CHECK_HANDLE(hUnderlineBoldFont);
 
-	wstring szContact = m_lpContact == NULL ? m_szContact : m_lpContact->GetDisplayName();
+	wstring szContact = m_lpContact == NULL ? GetContact() : m_lpContact->GetDisplayName();
 
 	//
 	// Paint the From.
@@ -76,9 +79,9 @@ INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExclude
 	// Paint unread.
 	//
 
-	if (m_uUnread > 1)
+	if (GetUnread() > 1)
 	{
-		szUnreadBuffer = Format(L" (%d)", m_uUnread);
+		szUnreadBuffer = Format(L" (%d)", GetUnread());
 
 		dc.DrawText(szUnreadBuffer, &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
 
@@ -106,7 +109,7 @@ INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExclude
 
 	dc.DrawText(szContact, &rc, DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
 
-	if (m_uUnread > 1)
+	if (GetUnread() > 1)
 	{
 		dc.SelectFont(hSelectedFont);
 
@@ -123,17 +126,17 @@ INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExclude
 	rc = rcClient;
 	rc.top = nOffset;
 
-	dc.DrawText(m_szSubject, &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
+	dc.DrawText(GetSubject(), &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
 	
 	nOffset = rc.bottom;
 
-	dc.DrawText(m_szSubject, &rc, DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
+	dc.DrawText(GetSubject(), &rc, DT_END_ELLIPSIS | DT_NOPREFIX | DT_SINGLELINE);
 
 	//
 	// Paint the Body
 	//
 
-	if (!m_szBody.empty())
+	if (!GetBody().empty())
 	{
 		nOffset += PL_LINE_SPACING;
 
@@ -146,14 +149,14 @@ INT CUnreadWave::Paint(CDC & dc, RECT & rcClient, BOOL fMouseOver, BOOL fExclude
 		rc = rcClient;
 		rc.top = nOffset;
 
-		dc.DrawText(m_szBody, &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
+		dc.DrawText(GetBody(), &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
 
 		INT nFullHeight = ((rc.bottom - rc.top) / tm.tmHeight) * tm.tmHeight;
 		INT nMaxHeight = ((rcClient.bottom - nOffset) / tm.tmHeight) * tm.tmHeight;
 
 		rc.bottom = rc.top + min(nFullHeight, nMaxHeight);
 
-		dc.DrawText(m_szBody, &rc, DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
+		dc.DrawText(GetBody(), &rc, DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
 	}
 
 	dc.SelectObject(hOriginal);
@@ -179,7 +182,7 @@ INT CUnreadWave::CalculateHeight(RECT & rcClient) const
 		tm.tmHeight + PL_LINE_SPACING + // Contact
 		tm.tmHeight; // Subject
 
-	if (!m_szBody.empty())
+	if (!GetBody().empty())
 	{
 		nOffset += PL_LINE_SPACING;
 
@@ -190,7 +193,7 @@ INT CUnreadWave::CalculateHeight(RECT & rcClient) const
 		RECT rc = rcClient;
 		rc.top = nOffset;
 
-		dc.DrawText(m_szBody, &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
+		dc.DrawText(GetBody(), &rc, DT_CALCRECT | DT_END_ELLIPSIS | DT_NOPREFIX | DT_WORDBREAK);
 
 		INT nFullHeight = ((rc.bottom - rc.top) / tm.tmHeight) * tm.tmHeight;
 		INT nMaxHeight = ((rcClient.bottom - nOffset) / tm.tmHeight) * tm.tmHeight;
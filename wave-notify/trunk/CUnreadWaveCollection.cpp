@@ -20,17 +20,22 @@
 #include "wave.h"
 #include "notifierapp.h"
 
-CUnreadWaveCollection::CUnreadWaveCollection(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent)
+CUnreadWaveCollection::CUnreadWaveCollection(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent, const TStringBoolMap * lpChanges)
 {
 	CNotifierApp::Instance()->GetSession()->SuspendRequestFlush();
 
+	// The email addresses of the messages are interned, so messages of
+	// self are found by comparing the handles.
+
+	m_lpSelf = CStringPool::Intern(CNotifierApp::Instance()->GetSession()->GetEmailAddress());
+
 	if (lpLastReported == NULL)
 	{
 		InsertAllWaves(lpCurrent);
 	}
 	else
 	{
-		InsertChangesOnly(lpLastReported, lpCurrent);
+		InsertChangesOnly(lpLastReported, lpCurrent, lpChanges);
 	}
 
 	CNotifierApp::Instance()->GetSession()->ReleaseRequestFlush();
@@ -42,6 +47,8 @@ CUnreadWaveCollection::~CUnreadWaveCollection()
 	{
 		delete *iter;
 	}
+
+	CStringPool::Release(m_lpSelf);
 }
 
 void CUnreadWaveCollection::InsertAllWaves(CWaveCollection * lpCurrent)
@@ -64,37 +71,66 @@ void CUnreadWaveCollection::InsertAllWaves(CWaveCollection * lpCurrent)
 	}
 }
 
-void CUnreadWaveCollection::InsertChangesOnly(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent)
+void CUnreadWaveCollection::InsertChangesOnly(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent, const TStringBoolMap * lpChanges)
 {
 	ASSERT(lpLastReported != NULL && lpCurrent != NULL);
 
 	const TWaveMap & vCurrent = lpCurrent->GetWaves();
-	const TWaveMap & vLastReported = lpLastReported->GetWaves();
-
-	for (TWaveMapConstIter iter = vCurrent.begin(); iter != vCurrent.end(); iter++)
-	{
-		TWaveMapConstIter pos = vLastReported.find(iter->first);
 
-		CWave * lpReportedWave = pos == vLastReported.end() ? NULL : pos->second;
+	// Without a list of changed waves, every wave of the current view
+	// is compared. Otherwise only the changed waves that are still in
+	// the view are.
 
-		WAVE_CHANGED_STATUS nStatus = GetChangedStatus(lpReportedWave, iter->second);
-
-		if (nStatus == WCHS_REFRESH)
+	if (lpChanges == NULL)
+	{
+		for (TWaveMapConstIter iter = vCurrent.begin(); iter != vCurrent.end(); iter++)
 		{
-			lpLastReported->AddWave(new CWave(*iter->second));
+			InsertChange(lpLastReported, iter->second);
 		}
-		else if (nStatus == WCHS_CHANGED)
+	}
+	else
+	{
+		for (TStringBoolMapConstIter iter = lpChanges->begin(); iter != lpChanges->end(); iter++)
 		{
-			CUnreadWave * lpUnread = GetDifference(lpReportedWave, iter->second);
+			TWaveMapConstIter pos = vCurrent.find(iter->first);
 
-			if (lpUnread != NULL)
+			if (pos != vCurrent.end())
 			{
-				Insert(lpUnread);
+				InsertChange(lpLastReported, pos->second);
 			}
 		}
 	}
 }
 
+void CUnreadWaveCollection::InsertChange(CWaveCollection * lpLastReported, CWave * lpWave)
+{
+	ASSERT(lpLastReported != NULL && lpWave != NULL);
+
+	const TWaveMap & vLastReported = lpLastReported->GetWaves();
+
+	TWaveMapConstIter pos = vLastReported.find(lpWave->GetID());
+
+	CWave * lpReportedWave = pos == vLastReported.end() ? NULL : pos->second;
+
+	WAVE_CHANGED_STATUS nStatus = GetChangedStatus(lpReportedWave, lpWave);
+
+	if (nStatus == WCHS_REFRESH)
+	{
+		lpWave->AddRef();
+
+		lpLastReported->AddWave(lpWave);
+	}
+	else if (nStatus == WCHS_CHANGED)
+	{
+		CUnreadWave * lpUnread = GetDifference(lpReportedWave, lpWave);
+
+		if (lpUnread != NULL)
+		{
+			Insert(lpUnread);
+		}
+	}
+}
+
 void CUnreadWaveCollection::Insert(CUnreadWave * lpUnread)
 {
 	ASSERT(lpUnread != NULL);
@@ -150,24 +186,11 @@ CUnreadWave * CUnreadWaveCollection::GetDifference(CWave * lpReportedWave, CWave
 
 	if (lpReportedWave != NULL)
 	{
-		const TWaveMessageVector & vReportedMessages = lpReportedWave->GetMessages();
-
-		for (TWaveMessageVectorConstIter iter_n = vNewMessages.begin(); iter_n != vNewMessages.end(); iter_n++)
+		for (TWaveMessageVectorConstIter iter = vNewMessages.begin(); iter != vNewMessages.end(); iter++)
 		{
-			BOOL fFound = FALSE;
-
-			for (TWaveMessageVectorConstIter iter_r = vReportedMessages.begin(); iter_r != vReportedMessages.end(); iter_r++)
-			{
-				if (**iter_n == **iter_r)
-				{
-					fFound = TRUE;
-					break;
-				}
-			}
-
-			if (!fFound)
+			if (!lpReportedWave->HasFingerprint((*iter)->GetFingerprint()))
 			{
-				lpToReport = *iter_n;
+				lpToReport = *iter;
 				break;
 			}
 		}
@@ -199,8 +222,6 @@ WAVE_CHANGED_STATUS CUnreadWaveCollection::GetChangedStatus(CWave * lpReportedWa
 		return WCHS_REFRESH;
 	}
 
-	wstring szSelf = CNotifierApp::Instance()->GetSession()->GetEmailAddress();
-
 	if (lpReportedWave == NULL)
 	{
 		// New waves with only messages of self (i.e. a new wave that is
@@ -216,12 +237,12 @@ WAVE_CHANGED_STATUS CUnreadWaveCollection::GetChangedStatus(CWave * lpReportedWa
 		{
 			fHadOne = TRUE;
 
-			if ((*iter)->GetEmailAddress() != szSelf)
+			if ((*iter)->GetInternedEmailAddress() != m_lpSelf)
 			{
 				fIsSelf = FALSE;
 			}
 
-			if (!(*iter)->GetText().empty())
+			if ((*iter)->GetLength() > 0)
 			{
 				fIsEmpty = FALSE;
 			}
@@ -241,20 +262,32 @@ WAVE_CHANGED_STATUS CUnreadWaveCollection::GetChangedStatus(CWave * lpReportedWa
 	// not consider the new wave. These messages will disappear when the owner
 	// stops typing.
 
-	TWaveMessageVector vReportedMessages(lpReportedWave->GetMessages());
+	// Every reported message is matched by one new message at most. The
+	// fingerprints of the reported wave are sorted, so the matches are
+	// found with a binary search and marked as used.
+
+	const TFingerprintVector & vReported = lpReportedWave->GetFingerprints();
 	const TWaveMessageVector & vNewMessages = lpNewWave->GetMessages();
 
+	vector<bool> vUsed(vReported.size(), false);
+
 	for (TWaveMessageVectorConstIter iter_n = vNewMessages.begin(); iter_n != vNewMessages.end(); iter_n++)
 	{
+		ULONGLONG uFingerprint = (*iter_n)->GetFingerprint();
 		BOOL fFound = FALSE;
 
-		for (TWaveMessageVectorIter iter_r = vReportedMessages.begin(); iter_r != vReportedMessages.end(); iter_r++)
-		{
-			if (**iter_n == **iter_r)
+		for (
+			TFingerprintVectorConstIter iter_r = lower_bound(vReported.begin(), vReported.end(), uFingerprint);
+			iter_r != vReported.end() && *iter_r == uFingerprint;
+			iter_r++
+		) {
+			size_t nIndex = iter_r - vReported.begin();
+
+			if (!vUsed[nIndex])
 			{
 				fFound = TRUE;
 
-				vReportedMessages.erase(iter_r);
+				vUsed[nIndex] = true;
 				break;
 			}
 		}
@@ -262,8 +295,8 @@ WAVE_CHANGED_STATUS CUnreadWaveCollection::GetChangedStatus(CWave * lpReportedWa
 		if (!fFound)
 		{
 			if (
-				(*iter_n)->GetEmailAddress() == szSelf ||
-				Trim((*iter_n)->GetText()).empty()
+				(*iter_n)->GetInternedEmailAddress() == m_lpSelf ||
+				(*iter_n)->IsBlank()
 			) {
 				nNewMessages--;
 			}
@@ -291,6 +324,11 @@ BOOL CUnreadWaveCollection::WavesEqual(CWave * lpReportedWave, CWave * lpNewWave
 		return FALSE;
 	}
 
+	if (lpReportedWave == lpNewWave)
+	{
+		return TRUE;
+	}
+
 	if (
 		lpReportedWave->GetTotalMessages() != lpNewWave->GetTotalMessages() ||
 		lpReportedWave->GetUnreadMessages() != lpNewWave->GetUnreadMessages() ||
@@ -301,25 +339,22 @@ BOOL CUnreadWaveCollection::WavesEqual(CWave * lpReportedWave, CWave * lpNewWave
 
 	// We do not detect whether all messages are the same but rather whether
 	// all messages in the new wave appear as such in the old wave. This is
-	// equal for us.
+	// equal for us. Both fingerprint vectors are sorted, so this is a
+	// single walk over both.
 
-	const TWaveMessageVector & vReportedMessages = lpReportedWave->GetMessages();
-	const TWaveMessageVector & vNewMessages = lpNewWave->GetMessages();
+	const TFingerprintVector & vReported = lpReportedWave->GetFingerprints();
+	const TFingerprintVector & vNew = lpNewWave->GetFingerprints();
 
-	for (TWaveMessageVectorConstIter iter_n = vNewMessages.begin(); iter_n != vNewMessages.end(); iter_n++)
-	{
-		BOOL fFound = FALSE;
+	TFingerprintVectorConstIter iter_r = vReported.begin();
 
-		for (TWaveMessageVectorConstIter iter_r = vReportedMessages.begin(); iter_r != vReportedMessages.end(); iter_r++)
+	for (TFingerprintVectorConstIter iter_n = vNew.begin(); iter_n != vNew.end(); iter_n++)
+	{
+		while (iter_r != vReported.end() && *iter_r < *iter_n)
 		{
-			if (**iter_n == **iter_r)
-			{
-				fFound = TRUE;
-				break;
-			}
+			iter_r++;
 		}
 
-		if (!fFound)
+		if (iter_r == vReported.end() || *iter_r != *iter_n)
 		{
 			return FALSE;
 		}
@@ -21,35 +21,24 @@
 
 CWave::CWave() :
 	m_uMessages(0),
-	m_uUnreadMessages(0)
+	m_uUnreadMessages(0),
+	m_uTextLength(0)
 {
 }
 
-CWave::CWave(const CWave & _Other)
+CWave::~CWave()
 {
-	m_szID = _Other.m_szID;
-	m_uMessages = _Other.m_uMessages;
-	m_uUnreadMessages = _Other.m_uUnreadMessages;
-	m_szSubject = _Other.m_szSubject;
-	m_szEmailAddress = _Other.m_szEmailAddress;
-	m_dtTime = _Other.m_dtTime;
-
-	for (TStringVectorConstIter iter = _Other.m_vContacts.begin(); iter != _Other.m_vContacts.end(); iter++)
+	for (TWaveMessageVectorIter iter = m_vMessages.begin(); iter != m_vMessages.end(); iter++)
 	{
-		m_vContacts.push_back(*iter);
+		delete *iter;
 	}
 
-	for (TWaveMessageVectorConstIter iter1 = _Other.m_vMessages.begin(); iter1 != _Other.m_vMessages.end(); iter1++)
-	{
-		m_vMessages.push_back(new CWaveMessage(**iter1));
-	}
-}
+	// The messages point into the contacts of the wave, so these are
+	// released after the messages are gone.
 
-CWave::~CWave()
-{
-	for (TWaveMessageVectorIter iter = m_vMessages.begin(); iter != m_vMessages.end(); iter++)
+	for (TInternedVectorIter iter1 = m_vContacts.begin(); iter1 != m_vContacts.end(); iter1++)
 	{
-		delete *iter;
+		CStringPool::Release(*iter1);
 	}
 }
 
@@ -104,13 +93,16 @@ CWave * CWave::CreateFromJson(Json::Value & vRoot)
 			goto __failure;
 		}
 
+		lpResult->UpdateFingerprints();
+		lpResult->CompactMessages();
+
 		return lpResult;
 	}
 
 __failure:
 	LOG("Could not parse json");
 
-	delete lpResult;
+	lpResult->Release();
 
 	return NULL;
 }
@@ -129,7 +121,7 @@ BOOL CWave::AddContacts(Json::Value & vRoot)
 			return FALSE;
 		}
 
-		m_vContacts.push_back((*iter).asString());
+		m_vContacts.push_back(CStringPool::Intern((*iter).asString()));
 	}
 
 	return TRUE;
@@ -162,3 +154,51 @@ BOOL CWave::AddMessages(Json::Value & vRoot)
 
 	return TRUE;
 }
+
+void CWave::UpdateFingerprints()
+{
+	// The fingerprints of the messages are kept sorted, so finding out
+	// whether a message appears in this wave is a binary search instead
+	// of comparing it against every message.
+
+	m_vFingerprints.clear();
+	m_vFingerprints.reserve(m_vMessages.size());
+
+	for (TWaveMessageVectorConstIter iter = m_vMessages.begin(); iter != m_vMessages.end(); iter++)
+	{
+		m_vFingerprints.push_back((*iter)->GetFingerprint());
+	}
+
+	sort(m_vFingerprints.begin(), m_vFingerprints.end());
+}
+
+void CWave::CompactMessages()
+{
+	// Only waves with unread messages are reported, so the messages of
+	// the other waves never have their text shown. The wave is diffed on
+	// the fingerprints, which stay.
+
+	if (m_uUnreadMessages == 0)
+	{
+		DiscardText();
+
+		return;
+	}
+
+	m_uTextLength = 0;
+
+	for (TWaveMessageVectorConstIter iter = m_vMessages.begin(); iter != m_vMessages.end(); iter++)
+	{
+		m_uTextLength += (*iter)->GetText().length();
+	}
+}
+
+void CWave::DiscardText()
+{
+	for (TWaveMessageVectorIter iter = m_vMessages.begin(); iter != m_vMessages.end(); iter++)
+	{
+		(*iter)->DiscardText();
+	}
+
+	m_uTextLength = 0;
+}
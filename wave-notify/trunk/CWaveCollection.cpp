@@ -23,7 +23,7 @@ CWaveCollection::~CWaveCollection()
 {
 	for (TWaveMapIter iter = m_vWaves.begin(); iter != m_vWaves.end(); iter++)
 	{
-		delete iter->second;
+		iter->second->Release();
 	}
 }
 
@@ -73,7 +73,7 @@ void CWaveCollection::Merge(CWaveCollection * lpWaves)
 		{
 			if (pos->second != NULL)
 			{
-				delete pos->second;
+				pos->second->Release();
 			}
 
 			m_vWaves.erase(pos);
@@ -100,7 +100,7 @@ void CWaveCollection::RemoveWaves(const TStringVector & vRemovedWaves)
 		{
 			if (pos->second != NULL)
 			{
-				delete pos->second;
+				pos->second->Release();
 			}
 
 			m_vWaves.erase(pos);
@@ -116,7 +116,7 @@ void CWaveCollection::AddWave(CWave * lpWave)
 	{
 		if (pos->second != NULL)
 		{
-			delete pos->second;
+			pos->second->Release();
 		}
 
 		m_vWaves.erase(pos);
@@ -69,17 +69,6 @@ CWaveContact * CWaveContact::CreateFromJson(Json::Value & vRoot)
 		lpResult->m_szEmailAddress = vEmailAddress.asString();
 		lpResult->m_szName = vName.type() == Json::nullValue ? lpResult->m_szEmailAddress : vName.asString();
 		lpResult->m_szAvatarUrl = vAvatarUrl.asString();
-		lpResult->m_fIsSelf =
-			(lpResult->m_szEmailAddress == CNotifierApp::Instance()->GetSession()->GetEmailAddress());
-		lpResult->m_fRequestedAvatar = lpResult->m_szAvatarUrl.empty();
-		lpResult->m_lpAvatar = NULL;
-
-		if (!lpResult->m_fIsSelf)
-		{
-			lpResult->m_szDisplayName = lpResult->m_szName;
-		}
-
-		TStringBoolMap vNamesRead;
 
 		for (Json::Value::iterator iter = vNames.begin(); iter != vNames.end(); iter++)
 		{
@@ -90,32 +79,10 @@ CWaveContact * CWaveContact::CreateFromJson(Json::Value & vRoot)
 				goto __failure;
 			}
 
-			if (vNamesRead.find(lpName->GetName()) == vNamesRead.end())
-			{
-				lpResult->m_vNames.push_back(lpName);
-
-				vNamesRead[lpName->GetName()] = TRUE;
-
-				if (
-					lpResult->m_fIsSelf &&
-					lpResult->m_szDisplayName.empty() &&
-					lpName->GetType() == WNT_SELF)
-				{
-					lpResult->m_szDisplayName = lpName->GetName();
-				}
-			}
-			else
-			{
-				delete lpName;
-			}
+			lpResult->m_vNames.push_back(lpName);
 		}
 
-		if (lpResult->m_szDisplayName.empty())
-		{
-			lpResult->m_szDisplayName = lpResult->m_szEmailAddress;
-		}
-
-		lpResult->m_szDisplayName[0] = towupper(lpResult->m_szDisplayName[0]);
+		lpResult->Complete();
 
 		return lpResult;
 	}
@@ -128,6 +95,55 @@ __failure:
 	return NULL;
 }
 
+void CWaveContact::Complete()
+{
+	m_szKey = towlower(m_szEmailAddress);
+	m_fIsSelf = (m_szEmailAddress == CNotifierApp::Instance()->GetSession()->GetEmailAddress());
+	m_fRequestedAvatar = m_szAvatarUrl.empty();
+	m_lpAvatar = NULL;
+
+	if (!m_fIsSelf)
+	{
+		m_szDisplayName = m_szName;
+	}
+
+	TStringBoolMap vNamesRead;
+	TWaveNameVector vNames;
+
+	for (TWaveNameVectorIter iter = m_vNames.begin(); iter != m_vNames.end(); iter++)
+	{
+		CWaveName * lpName = *iter;
+
+		if (vNamesRead.find(lpName->GetName()) == vNamesRead.end())
+		{
+			vNames.push_back(lpName);
+
+			vNamesRead[lpName->GetName()] = TRUE;
+
+			if (
+				m_fIsSelf &&
+				m_szDisplayName.empty() &&
+				lpName->GetType() == WNT_SELF)
+			{
+				m_szDisplayName = lpName->GetName();
+			}
+		}
+		else
+		{
+			delete lpName;
+		}
+	}
+
+	m_vNames.swap(vNames);
+
+	if (m_szDisplayName.empty())
+	{
+		m_szDisplayName = m_szEmailAddress;
+	}
+
+	m_szDisplayName[0] = towupper(m_szDisplayName[0]);
+}
+
 void CWaveContact::Merge(CWaveContactStatus * lpStatus)
 {
 	ASSERT(lpStatus != NULL);
@@ -140,6 +156,11 @@ void CWaveContact::Merge(CWaveContact * lpContact)
 {
 	ASSERT(lpContact != NULL);
 
+	// The key stays as it is; the contact is only merged with a contact
+	// that has the same key.
+
+	ASSERT(m_szKey == lpContact->m_szKey);
+
 	m_szEmailAddress = lpContact->m_szEmailAddress;
 	m_szName = lpContact->m_szName;
 	m_szDisplayName = lpContact->m_szDisplayName;
@@ -21,9 +21,9 @@
 
 CWaveContactCollection::~CWaveContactCollection()
 {
-	for (TWaveContactMapIter iter = m_vContacts.begin(); iter != m_vContacts.end(); iter++)
+	for (TWaveContactVectorIter iter = m_vContacts.begin(); iter != m_vContacts.end(); iter++)
 	{
-		delete iter->second;
+		delete *iter;
 	}
 }
 
@@ -59,7 +59,12 @@ CWaveContactCollection * CWaveContactCollection::CreateFromJson(Json::Value & vR
 				lpContact = CWaveContact::CreateFromJson((*iter)[L"6"]);
 			}
 
-			lpResult->m_vContacts[lpContact->GetEmailAddress()] = lpContact;
+			if (lpContact == NULL)
+			{
+				goto __failure;
+			}
+
+			lpResult->AddContact(lpContact);
 		}
 
 		return lpResult;
@@ -77,19 +82,21 @@ void CWaveContactCollection::Merge(CWaveContactCollection * lpContacts)
 {
 	ASSERT(lpContacts != NULL);
 
-	for (TWaveContactMapIter iter = lpContacts->m_vContacts.begin(); iter != lpContacts->m_vContacts.end(); iter++)
+	for (TWaveContactVectorIter iter = lpContacts->m_vContacts.begin(); iter != lpContacts->m_vContacts.end(); iter++)
 	{
-		TWaveContactMapIter pos = m_vContacts.find(iter->first);
+		CWaveContact * lpContact = *iter;
 
-		if (pos != m_vContacts.end())
+		if (!AddContact(lpContact))
 		{
-			pos->second->Merge(iter->second);
-
-			delete iter->second;
+			continue;
 		}
-		else
+
+		// Contacts only enter the view through here, so this is
+		// where they are queued for their avatar.
+
+		if (!lpContact->GetRequestedAvatar())
 		{
-			m_vContacts[iter->second->GetEmailAddress()] = iter->second;
+			m_vNeedsAvatar.push(lpContact);
 		}
 	}
 
@@ -97,6 +104,7 @@ void CWaveContactCollection::Merge(CWaveContactCollection * lpContacts)
 	// clear out the other collection.
 
 	lpContacts->m_vContacts.clear();
+	lpContacts->m_vIndex.clear();
 }
 
 void CWaveContactCollection::Merge(CWaveContactStatusCollection * lpStatuses)
@@ -107,11 +115,147 @@ void CWaveContactCollection::Merge(CWaveContactStatusCollection * lpStatuses)
 
 	for (TWaveContactStatusMapConstIter iter = vStatuses.begin(); iter != vStatuses.end(); iter++)
 	{
-		TWaveContactMapIter pos = m_vContacts.find(iter->first);
+		CWaveContact * lpContact = GetContact(iter->first);
+
+		if (lpContact != NULL)
+		{
+			lpContact->Merge(iter->second);
+		}
+	}
+}
+
+CWaveContact * CWaveContactCollection::GetContact(const wstring & szEmailAddress) const
+{
+	CHECK_NOT_EMPTY(szEmailAddress);
+
+	if (m_vIndex.empty())
+	{
+		return NULL;
+	}
+
+	return m_vIndex[FindSlot(szEmailAddress.c_str())];
+}
+
+CWaveContact * CWaveContactCollection::GetNeedsAvatar()
+{
+	// A contact stays at the front of the queue until its avatar has been
+	// requested, so the contact of a running avatar request is returned
+	// again until its response has been processed.
+
+	while (!m_vNeedsAvatar.empty())
+	{
+		CWaveContact * lpContact = m_vNeedsAvatar.front();
 
-		if (pos != m_vContacts.end())
+		if (!lpContact->GetRequestedAvatar())
 		{
-			pos->second->Merge(iter->second);
+			return lpContact;
 		}
+
+		m_vNeedsAvatar.pop();
 	}
+
+	return NULL;
+}
+
+BOOL CWaveContactCollection::AddContact(CWaveContact * lpContact)
+{
+	ASSERT(lpContact != NULL);
+
+	if ((m_vContacts.size() + 1) * 2 > m_vIndex.size())
+	{
+		GrowIndex();
+	}
+
+	// A contact with the same email address is merged into the one that
+	// is already there, which keeps its place in the collection.
+
+	UINT uSlot = FindSlot(lpContact->GetKey().c_str());
+	CWaveContact * lpExisting = m_vIndex[uSlot];
+
+	if (lpExisting != NULL)
+	{
+		lpExisting->Merge(lpContact);
+
+		delete lpContact;
+
+		return FALSE;
+	}
+
+	m_vIndex[uSlot] = lpContact;
+	m_vContacts.push_back(lpContact);
+
+	return TRUE;
+}
+
+UINT CWaveContactCollection::FindSlot(LPCWSTR szEmailAddress) const
+{
+	ASSERT(szEmailAddress != NULL && !m_vIndex.empty());
+
+	// The index is an open addressing table with linear probing. Its size
+	// is a power of two and it is never more than half full, so a probe
+	// always ends at the contact or at an empty slot.
+
+	// The contacts are keyed on their case folded email address. The
+	// address that is looked up is folded while it is hashed and
+	// compared, so a lookup does not allocate.
+
+	UINT uMask = m_vIndex.size() - 1;
+	UINT uSlot = (UINT)HashEmailAddress(szEmailAddress) & uMask;
+
+	while (m_vIndex[uSlot] != NULL)
+	{
+		LPCWSTR szKey = m_vIndex[uSlot]->GetKey().c_str();
+		LPCWSTR szChar = szEmailAddress;
+
+		while (*szKey != L'\0' && *szKey == towlower(*szChar))
+		{
+			szKey++;
+			szChar++;
+		}
+
+		if (*szKey == L'\0' && *szChar == L'\0')
+		{
+			break;
+		}
+
+		uSlot = (uSlot + 1) & uMask;
+	}
+
+	return uSlot;
+}
+
+void CWaveContactCollection::GrowIndex()
+{
+	TWaveContactVector vIndex(
+		m_vIndex.empty() ? WAVE_CONTACT_INDEX_MIN : m_vIndex.size() * 2,
+		(CWaveContact *)NULL);
+
+	m_vIndex.swap(vIndex);
+
+	for (TWaveContactVectorConstIter iter = m_vContacts.begin(); iter != m_vContacts.end(); iter++)
+	{
+		m_vIndex[FindSlot((*iter)->GetKey().c_str())] = *iter;
+	}
+}
+
+ULONGLONG CWaveContactCollection::HashEmailAddress(LPCWSTR szEmailAddress)
+{
+	ASSERT(szEmailAddress != NULL);
+
+	// Email addresses are hashed case folded, the same way
+	// CWaveContact::Complete folds the key of a contact.
+
+	ULONGLONG uHash = WAVE_FINGERPRINT_BASIS;
+
+	for (LPCWSTR szChar = szEmailAddress; *szChar != L'\0'; szChar++)
+	{
+		WCHAR cChar = towlower(*szChar);
+
+		uHash ^= (BYTE)cChar;
+		uHash *= WAVE_FINGERPRINT_PRIME;
+		uHash ^= (BYTE)(cChar >> 8);
+		uHash *= WAVE_FINGERPRINT_PRIME;
+	}
+
+	return uHash;
 }
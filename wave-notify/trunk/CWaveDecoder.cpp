@@ -0,0 +1,1754 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "include.h"
+#include "wave.h"
+
+#define WDF(_Field)		(1 << (_Field))
+#define WDF_ALL(_Fields, _Frame)	(((_Frame).dwFields & (_Fields)) == (_Fields))
+
+static BOOL IsIntegral(WAVE_DECODER_VALUE nValue)
+{
+	return nValue == WDV_INT || nValue == WDV_BOOL;
+}
+
+CWaveDecoder::CWaveDecoder() :
+	m_fIsFrame(FALSE),
+	m_lpItem(NULL),
+	m_lpResponse(NULL),
+	m_lpPayloadBuilder(NULL),
+	m_nPayloadDepth(0),
+	m_lReusedWaves(0),
+	m_lDecodedWaves(0)
+{
+	Reset();
+}
+
+CWaveDecoder::~CWaveDecoder()
+{
+	Reset();
+
+	for (TWaveDecoderHashMapIter iter = m_vHashes.begin(); iter != m_vHashes.end(); iter++)
+	{
+		iter->second.lpWave->Release();
+	}
+}
+
+void CWaveDecoder::Reset()
+{
+	// Frames that are left over from an aborted parse still own the
+	// objects they were decoding.
+
+	for (TWaveDecoderFrameVectorIter iter = m_vFrames.begin(); iter != m_vFrames.end(); iter++)
+	{
+		DeleteFrameObject(*iter);
+	}
+
+	m_vFrames.clear();
+
+	for (TWaveChannelItemVectorIter iter1 = m_vItems.begin(); iter1 != m_vItems.end(); iter1++)
+	{
+		delete *iter1;
+	}
+
+	m_vItems.clear();
+
+	if (m_lpResponse != NULL)
+	{
+		delete m_lpResponse;
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		delete m_lpPayloadBuilder;
+	}
+
+	m_fIsFrame = FALSE;
+	m_lpItem = NULL;
+	m_fHadType = FALSE;
+	m_fHadPayload = FALSE;
+	m_fResponseFailed = FALSE;
+	m_nResponseType = WMT_UNKNOWN;
+	m_szRequestID = L"";
+	m_fFinal = TRUE;
+	m_lpResponse = NULL;
+	m_vPayloadArena.clear();
+	m_lpPayloadBuilder = NULL;
+	m_nPayloadDepth = 0;
+	m_uTimeMinor = 0;
+	m_uTimeMajor = 0;
+
+	// The hashes of the waves survive a reset; they are what allows the
+	// waves of the next response to be reused.
+
+	m_fHashing = FALSE;
+	m_uHash = 0;
+}
+
+bool CWaveDecoder::startObject()
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('{');
+
+		Enter(WDV_OBJECT);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_nPayloadDepth++;
+
+		return m_lpPayloadBuilder->startObject();
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::objectKey(const std::wstring & key)
+{
+	if (m_lpPayloadBuilder != NULL)
+	{
+		return m_lpPayloadBuilder->objectKey(key);
+	}
+
+	Hash('K', key.c_str(), key.length() * sizeof(WCHAR));
+
+	if (!m_vFrames.empty())
+	{
+		m_vFrames.back().szKey = key;
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::endObject()
+{
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->endObject();
+
+		if (--m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+	else
+	{
+		Hash('}');
+
+		Leave();
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::startArray()
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('[');
+
+		Enter(WDV_ARRAY);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_nPayloadDepth++;
+
+		return m_lpPayloadBuilder->startArray();
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::endArray()
+{
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->endArray();
+
+		if (--m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+	else
+	{
+		Hash(']');
+
+		Leave();
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::stringValue(std::wstring & value)
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		// The string is hashed before it is handed to the model, which
+		// may take the contents.
+
+		Hash('S', value.c_str(), value.length() * sizeof(WCHAR));
+
+		Scalar(WDV_STRING, 0, &value);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->stringValue(value);
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::intValue(Json::Value::Int value)
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('I', &value, sizeof(value));
+
+		Scalar(WDV_INT, (UINT)value, NULL);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->intValue(value);
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::uintValue(Json::Value::UInt value)
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('U', &value, sizeof(value));
+
+		Scalar(WDV_INT, value, NULL);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->uintValue(value);
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::doubleValue(double value)
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('D', &value, sizeof(value));
+
+		Scalar(WDV_OTHER, 0, NULL);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->doubleValue(value);
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::boolValue(bool value)
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash(value ? 'T' : 'F');
+
+		Scalar(WDV_BOOL, value ? 1 : 0, NULL);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->boolValue(value);
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+bool CWaveDecoder::nullValue()
+{
+	if (m_lpPayloadBuilder == NULL)
+	{
+		Hash('N');
+
+		Scalar(WDV_NULL, 0, NULL);
+	}
+
+	if (m_lpPayloadBuilder != NULL)
+	{
+		m_lpPayloadBuilder->nullValue();
+
+		if (m_nPayloadDepth == 0)
+		{
+			EndPayload();
+		}
+	}
+
+	return true;
+}
+
+void CWaveDecoder::Enter(WAVE_DECODER_VALUE nValue)
+{
+	if (m_vFrames.empty())
+	{
+		// The channel frame must be an array of items.
+
+		m_fIsFrame = nValue == WDV_ARRAY;
+
+		PushFrame(m_fIsFrame ? WDC_FRAME : WDC_SKIP);
+
+		return;
+	}
+
+	WAVE_DECODER_FRAME & vParent = m_vFrames.back();
+
+	if (vParent.nContext == WDC_RESPONSE && vParent.szKey == L"p")
+	{
+		BeginPayload(nValue);
+
+		return;
+	}
+
+	WAVE_DECODER_CONTEXT nContext = GetChildContext(vParent, nValue);
+	LPVOID lpObject = vParent.lpObject;
+
+	switch (nContext)
+	{
+	case WDC_ITEM:
+		m_lpItem = new CWaveChannelItem();
+		m_vItems.push_back(m_lpItem);
+		lpObject = m_lpItem;
+		break;
+
+	case WDC_RESPONSE:
+		m_fHadType = FALSE;
+		m_fHadPayload = FALSE;
+		m_fResponseFailed = FALSE;
+		m_nResponseType = WMT_UNKNOWN;
+		m_szRequestID = L"";
+		m_fFinal = TRUE;
+		m_vPayloadArena.clear();
+		break;
+
+	case WDC_WAVES:
+		lpObject = new CWaveCollection();
+		break;
+
+	case WDC_WAVE:
+		lpObject = new CWave();
+
+		// Everything inside the wave object is hashed, so a wave that
+		// is sent again unchanged can be recognised once it completes.
+
+		m_fHashing = TRUE;
+		m_uHash = WAVE_FINGERPRINT_BASIS;
+		break;
+
+	case WDC_MESSAGE:
+		lpObject = new CWaveMessage();
+		break;
+
+	case WDC_CONTACTS:
+		lpObject = new CWaveContactCollection();
+		break;
+
+	case WDC_CONTACT:
+	case WDC_CONTACT_DETAILS:
+		lpObject = new CWaveContact();
+		break;
+
+	case WDC_NAME:
+		lpObject = new CWaveName();
+		break;
+
+	case WDC_STATUSES:
+		lpObject = new CWaveContactStatusCollection();
+		break;
+
+	case WDC_STATUS:
+		lpObject = new CWaveContactStatus();
+		break;
+	}
+
+	PushFrame(nContext, lpObject);
+}
+
+void CWaveDecoder::Leave()
+{
+	ASSERT(!m_vFrames.empty());
+
+	size_t nSize = m_vFrames.size();
+
+	if (nSize > 1)
+	{
+		CompleteFrame(m_vFrames[nSize - 1], m_vFrames[nSize - 2]);
+	}
+
+	m_vFrames.pop_back();
+
+	NextValue();
+}
+
+void CWaveDecoder::Scalar(WAVE_DECODER_VALUE nValue, UINT uValue, wstring * lpValue)
+{
+	if (m_vFrames.empty())
+	{
+		// A null frame is taken as an empty one.
+
+		m_fIsFrame = nValue == WDV_NULL;
+
+		return;
+	}
+
+	WAVE_DECODER_FRAME & vFrame = m_vFrames.back();
+
+	if (vFrame.nContext == WDC_RESPONSE && vFrame.szKey == L"p")
+	{
+		BeginPayload(nValue);
+	}
+	else
+	{
+		AssignScalar(vFrame, nValue, uValue, lpValue);
+	}
+
+	if (m_lpPayloadBuilder == NULL)
+	{
+		NextValue();
+	}
+}
+
+void CWaveDecoder::NextValue()
+{
+	if (!m_vFrames.empty())
+	{
+		m_vFrames.back().uIndex++;
+	}
+}
+
+void CWaveDecoder::PushFrame(WAVE_DECODER_CONTEXT nContext, LPVOID lpObject)
+{
+	WAVE_DECODER_FRAME vFrame;
+
+	vFrame.nContext = nContext;
+	vFrame.uIndex = 0;
+	vFrame.dwFields = 0;
+	vFrame.fInvalid = FALSE;
+	vFrame.lpObject = lpObject;
+	vFrame.lpChild = NULL;
+
+	m_vFrames.push_back(vFrame);
+}
+
+WAVE_DECODER_CONTEXT CWaveDecoder::GetChildContext(WAVE_DECODER_FRAME & vParent, WAVE_DECODER_VALUE nValue)
+{
+	const wstring & szKey = vParent.szKey;
+
+	switch (vParent.nContext)
+	{
+	case WDC_FRAME:
+		if (nValue == WDV_ARRAY)
+		{
+			return WDC_ITEM;
+		}
+
+		// Record the item as invalid so processing stops here.
+
+		m_vItems.push_back(new CWaveChannelItem());
+		break;
+
+	case WDC_ITEM:
+		if (vParent.uIndex == 1 && nValue == WDV_ARRAY)
+		{
+			return WDC_CONTENT;
+		}
+		break;
+
+	case WDC_CONTENT:
+		if (
+			vParent.uIndex == 1 &&
+			nValue == WDV_OBJECT &&
+			((CWaveChannelItem *)vParent.lpObject)->m_nType == WCIT_RESPONSE
+		) {
+			return WDC_RESPONSE;
+		}
+		break;
+
+	case WDC_RESPONSE:
+		if (szKey == L"t" || szKey == L"r" || szKey == L"f")
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_PAYLOAD:
+		return GetPayloadContext(vParent, nValue);
+
+	case WDC_WAVES:
+		if (nValue == WDV_OBJECT)
+		{
+			return WDC_WAVE;
+		}
+
+		FailResponse();
+		break;
+
+	case WDC_WAVE:
+		if (szKey == L"5" && nValue == WDV_ARRAY)
+		{
+			return WDC_WAVE_CONTACTS;
+		}
+		else if (szKey == L"8" && nValue == WDV_ARRAY)
+		{
+			return WDC_WAVE_TIME;
+		}
+		else if (szKey == L"9" && nValue == WDV_OBJECT)
+		{
+			return WDC_WAVE_SUBJECT;
+		}
+		else if (szKey == L"10" && nValue == WDV_ARRAY)
+		{
+			return WDC_MESSAGES;
+		}
+		else if (
+			szKey == L"1" || szKey == L"4" || szKey == L"6" || szKey == L"7" ||
+			szKey == L"8" || szKey == L"9"
+		) {
+			FailResponse();
+		}
+		else if ((szKey == L"5" || szKey == L"10") && nValue != WDV_NULL)
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_MESSAGES:
+		if (nValue == WDV_OBJECT)
+		{
+			return WDC_MESSAGE;
+		}
+
+		FailResponse();
+		break;
+
+	case WDC_CONTACTS:
+		if (nValue == WDV_OBJECT)
+		{
+			return WDC_CONTACT;
+		}
+
+		FailResponse();
+		break;
+
+	case WDC_CONTACT:
+	case WDC_CONTACT_DETAILS:
+		if (szKey == L"7" && nValue == WDV_ARRAY)
+		{
+			return WDC_NAMES;
+		}
+		else if (vParent.nContext == WDC_CONTACT && szKey == L"6")
+		{
+			// The contact details list wraps the contact in an object.
+
+			if (nValue == WDV_OBJECT)
+			{
+				return WDC_CONTACT_DETAILS;
+			}
+		}
+		else if (szKey == L"1" || szKey == L"2" || szKey == L"7")
+		{
+			vParent.fInvalid = TRUE;
+		}
+		break;
+
+	case WDC_NAMES:
+		if (nValue == WDV_OBJECT)
+		{
+			return WDC_NAME;
+		}
+
+		InvalidateContact();
+		break;
+
+	case WDC_NAME:
+		if (szKey == L"2" && nValue == WDV_OBJECT)
+		{
+			return WDC_NAME_DETAILS;
+		}
+		else if (szKey == L"1" || szKey == L"2")
+		{
+			InvalidateContact();
+		}
+		break;
+
+	case WDC_STATUSES:
+		if (nValue == WDV_OBJECT)
+		{
+			return WDC_STATUS;
+		}
+
+		FailResponse();
+		break;
+
+	case WDC_STATUS:
+		if (szKey == L"2" && nValue == WDV_OBJECT)
+		{
+			return WDC_STATUS_CONTACT;
+		}
+		else if (szKey == L"3" && nValue == WDV_OBJECT)
+		{
+			return WDC_STATUS_DETAILS;
+		}
+		else if (szKey == L"2" || szKey == L"3")
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_WAVE_CONTACTS:
+	case WDC_WAVE_TIME:
+	case WDC_REMOVED_WAVES:
+		FailResponse();
+		break;
+
+	case WDC_WAVE_SUBJECT:
+	case WDC_MESSAGE:
+	case WDC_STATUSES_EMPTY:
+	case WDC_STATUS_CONTACT:
+	case WDC_STATUS_DETAILS:
+		if (
+			szKey == L"1" ||
+			(vParent.nContext == WDC_MESSAGE && szKey == L"6") ||
+			(vParent.nContext == WDC_STATUS_DETAILS && (szKey == L"2" || szKey == L"3"))
+		) {
+			FailResponse();
+		}
+		break;
+
+	case WDC_NAME_DETAILS:
+		if (szKey == L"1")
+		{
+			InvalidateContact();
+		}
+		break;
+	}
+
+	return WDC_SKIP;
+}
+
+WAVE_DECODER_CONTEXT CWaveDecoder::GetPayloadContext(WAVE_DECODER_FRAME & vParent, WAVE_DECODER_VALUE nValue)
+{
+	const wstring & szKey = vParent.szKey;
+
+	// Missing and null collections are read as empty collections.
+
+	if (nValue == WDV_NULL)
+	{
+		return WDC_SKIP;
+	}
+
+	switch (m_nResponseType)
+	{
+	case WMT_START_LISTENING:
+		if (szKey == L"1")
+		{
+			if (nValue == WDV_ARRAY)
+			{
+				return WDC_WAVES;
+			}
+
+			FailResponse();
+		}
+		else if (szKey == L"3")
+		{
+			if (nValue == WDV_ARRAY)
+			{
+				return WDC_REMOVED_WAVES;
+			}
+
+			FailResponse();
+		}
+		break;
+
+	case WMT_GET_ALL_CONTACTS:
+	case WMT_GET_CONTACT_DETAILS:
+		if (szKey == L"2")
+		{
+			if (nValue == WDV_ARRAY)
+			{
+				return WDC_CONTACTS;
+			}
+
+			FailResponse();
+		}
+		break;
+
+	case WMT_CONTACT_UPDATES:
+		if (szKey == L"1")
+		{
+			// An empty status collection is sent as { "1": 0 }.
+
+			if (nValue == WDV_ARRAY)
+			{
+				return WDC_STATUSES;
+			}
+			else if (nValue == WDV_OBJECT)
+			{
+				return WDC_STATUSES_EMPTY;
+			}
+
+			FailResponse();
+		}
+		break;
+	}
+
+	return WDC_SKIP;
+}
+
+void CWaveDecoder::AssignScalar(WAVE_DECODER_FRAME & vFrame, WAVE_DECODER_VALUE nValue, UINT uValue, wstring * lpValue)
+{
+	const wstring & szKey = vFrame.szKey;
+
+	switch (vFrame.nContext)
+	{
+	case WDC_FRAME:
+		m_vItems.push_back(new CWaveChannelItem());
+		break;
+
+	case WDC_ITEM:
+		if (vFrame.uIndex == 0 && IsIntegral(nValue))
+		{
+			((CWaveChannelItem *)vFrame.lpObject)->m_nAID = (INT)uValue;
+			vFrame.dwFields |= WDF(0);
+		}
+		break;
+
+	case WDC_CONTENT:
+		if (vFrame.uIndex == 0 && nValue == WDV_STRING)
+		{
+			CWaveChannelItem * lpItem = (CWaveChannelItem *)vFrame.lpObject;
+
+			if (*lpValue == L"c")
+			{
+				lpItem->m_nType = WCIT_SID;
+			}
+			else if (*lpValue == L"wfe")
+			{
+				lpItem->m_nType = WCIT_RESPONSE;
+			}
+			else
+			{
+				// There are noop's being sent, but everything else is also
+				// ignored.
+
+				lpItem->m_nType = WCIT_NOOP;
+			}
+
+			vFrame.dwFields |= WDF(0);
+		}
+		else if (vFrame.uIndex == 1)
+		{
+			CWaveChannelItem * lpItem = (CWaveChannelItem *)vFrame.lpObject;
+
+			if (lpItem->m_nType == WCIT_SID && nValue == WDV_STRING)
+			{
+				lpItem->m_szSID.swap(*lpValue);
+				vFrame.dwFields |= WDF(1);
+			}
+			else if (lpItem->m_nType == WCIT_RESPONSE && nValue == WDV_NULL)
+			{
+				// A null payload does not carry a response.
+
+				vFrame.dwFields |= WDF(1);
+			}
+		}
+		break;
+
+	case WDC_RESPONSE:
+		if (szKey == L"t")
+		{
+			if (IsIntegral(nValue))
+			{
+				m_nResponseType = (WAVE_MESSAGE_TYPE)uValue;
+				m_fHadType = TRUE;
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		else if (szKey == L"r")
+		{
+			if (nValue == WDV_STRING)
+			{
+				m_szRequestID.swap(*lpValue);
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		else if (szKey == L"f")
+		{
+			if (IsIntegral(nValue))
+			{
+				m_fFinal = uValue != 0;
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		break;
+
+	case WDC_PAYLOAD:
+		GetPayloadContext(vFrame, nValue);
+		break;
+
+	case WDC_WAVE:
+		{
+			CWave * lpWave = (CWave *)vFrame.lpObject;
+
+			if (szKey == L"1" && nValue == WDV_STRING)
+			{
+				lpWave->m_szID.swap(*lpValue);
+				vFrame.dwFields |= WDF(1);
+			}
+			else if (szKey == L"4" && nValue == WDV_STRING)
+			{
+				lpWave->m_szEmailAddress.swap(*lpValue);
+				vFrame.dwFields |= WDF(4);
+			}
+			else if (szKey == L"6" && IsIntegral(nValue))
+			{
+				lpWave->m_uMessages = uValue;
+				vFrame.dwFields |= WDF(6);
+			}
+			else if (szKey == L"7" && (IsIntegral(nValue) || nValue == WDV_NULL))
+			{
+				lpWave->m_uUnreadMessages = uValue;
+			}
+			else
+			{
+				GetChildContext(vFrame, nValue);
+			}
+		}
+		break;
+
+	case WDC_WAVE_CONTACTS:
+		if (nValue == WDV_STRING)
+		{
+			CWave * lpWave = (CWave *)vFrame.lpObject;
+
+			lpWave->m_vContacts.push_back(CStringPool::Intern(*lpValue));
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_WAVE_TIME:
+		if (vFrame.uIndex < 2)
+		{
+			if (IsIntegral(nValue))
+			{
+				if (vFrame.uIndex == 0)
+				{
+					m_uTimeMinor = uValue;
+				}
+				else
+				{
+					m_uTimeMajor = uValue;
+				}
+
+				vFrame.dwFields |= WDF(vFrame.uIndex);
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		break;
+
+	case WDC_WAVE_SUBJECT:
+		if (szKey == L"1")
+		{
+			if (nValue == WDV_STRING)
+			{
+				((CWave *)vFrame.lpObject)->m_szSubject.swap(*lpValue);
+				vFrame.dwFields |= WDF(1);
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		break;
+
+	case WDC_MESSAGE:
+		{
+			CWaveMessage * lpMessage = (CWaveMessage *)vFrame.lpObject;
+
+			if (szKey == L"1" && nValue == WDV_STRING)
+			{
+				lpMessage->m_szText.swap(*lpValue);
+				vFrame.dwFields |= WDF(1);
+			}
+			else if (szKey == L"6" && IsIntegral(nValue))
+			{
+				lpMessage->m_uContactId = uValue;
+				vFrame.dwFields |= WDF(6);
+			}
+			else if (szKey == L"1" || szKey == L"6")
+			{
+				FailResponse();
+			}
+		}
+		break;
+
+	case WDC_REMOVED_WAVES:
+		if (nValue == WDV_STRING)
+		{
+			CWaveResponseStartListening * lpResponse = (CWaveResponseStartListening *)vFrame.lpObject;
+
+			ForgetWave(*lpValue);
+
+			lpResponse->m_vRemovedWaves.push_back(L"");
+			lpResponse->m_vRemovedWaves.back().swap(*lpValue);
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_CONTACT:
+	case WDC_CONTACT_DETAILS:
+		{
+			CWaveContact * lpContact = (CWaveContact *)vFrame.lpObject;
+
+			if (szKey == L"8")
+			{
+				// When the contact isn't wrapped, a missing email address
+				// means the contact details are under "6".
+
+				if (nValue == WDV_STRING)
+				{
+					lpContact->m_szEmailAddress.swap(*lpValue);
+					vFrame.dwFields |= WDF(8);
+				}
+				else if (vFrame.nContext == WDC_CONTACT_DETAILS)
+				{
+					vFrame.fInvalid = TRUE;
+				}
+			}
+			else if (szKey == L"1")
+			{
+				if (nValue == WDV_STRING)
+				{
+					lpContact->m_szName.swap(*lpValue);
+					vFrame.dwFields |= WDF(1);
+				}
+				else if (nValue != WDV_NULL)
+				{
+					vFrame.fInvalid = TRUE;
+				}
+			}
+			else if (szKey == L"2")
+			{
+				if (nValue == WDV_STRING)
+				{
+					lpContact->m_szAvatarUrl.swap(*lpValue);
+				}
+				else if (nValue != WDV_NULL)
+				{
+					vFrame.fInvalid = TRUE;
+				}
+			}
+			else if (szKey == L"7" && nValue != WDV_NULL)
+			{
+				vFrame.fInvalid = TRUE;
+			}
+		}
+		break;
+
+	case WDC_NAMES:
+		InvalidateContact();
+		break;
+
+	case WDC_NAME:
+		if (szKey == L"1" && nValue == WDV_STRING)
+		{
+			((CWaveName *)vFrame.lpObject)->m_szName.swap(*lpValue);
+			vFrame.dwFields |= WDF(1);
+		}
+		else if (szKey == L"1" || szKey == L"2")
+		{
+			InvalidateContact();
+		}
+		break;
+
+	case WDC_NAME_DETAILS:
+		if (szKey == L"1")
+		{
+			if (IsIntegral(nValue))
+			{
+				((CWaveName *)vFrame.lpObject)->m_nType = (WAVE_NAME_TYPE)uValue;
+				vFrame.dwFields |= WDF(1);
+			}
+			else
+			{
+				InvalidateContact();
+			}
+		}
+		break;
+
+	case WDC_WAVES:
+	case WDC_MESSAGES:
+	case WDC_CONTACTS:
+	case WDC_STATUSES:
+		FailResponse();
+		break;
+
+	case WDC_STATUSES_EMPTY:
+		if (szKey == L"1" && IsIntegral(nValue) && uValue == 0)
+		{
+			vFrame.dwFields |= WDF(1);
+		}
+		break;
+
+	case WDC_STATUS:
+		if (szKey == L"2" || szKey == L"3")
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_STATUS_CONTACT:
+		if (szKey == L"1")
+		{
+			if (nValue == WDV_STRING)
+			{
+				((CWaveContactStatus *)vFrame.lpObject)->m_szEmailAddress.swap(*lpValue);
+				vFrame.dwFields |= WDF(1);
+			}
+			else
+			{
+				FailResponse();
+			}
+		}
+		break;
+
+	case WDC_STATUS_DETAILS:
+		{
+			CWaveContactStatus * lpStatus = (CWaveContactStatus *)vFrame.lpObject;
+
+			if (szKey == L"2")
+			{
+				if (nValue == WDV_BOOL)
+				{
+					lpStatus->m_fOnline = uValue != 0;
+					vFrame.dwFields |= WDF(2);
+				}
+				else
+				{
+					FailResponse();
+				}
+			}
+			else if (szKey == L"3")
+			{
+				if (nValue == WDV_STRING)
+				{
+					lpStatus->m_szStatusMessage.swap(*lpValue);
+				}
+				else if (nValue != WDV_NULL)
+				{
+					FailResponse();
+				}
+			}
+		}
+		break;
+	}
+}
+
+void CWaveDecoder::CompleteFrame(WAVE_DECODER_FRAME & vFrame, WAVE_DECODER_FRAME & vParent)
+{
+	switch (vFrame.nContext)
+	{
+	case WDC_ITEM:
+		((CWaveChannelItem *)vFrame.lpObject)->m_fSuccess = WDF_ALL(WDF(0) | WDF(1), vFrame);
+		m_lpItem = NULL;
+		break;
+
+	case WDC_CONTENT:
+		if (
+			WDF_ALL(WDF(0), vFrame) &&
+			(((CWaveChannelItem *)vFrame.lpObject)->m_nType == WCIT_NOOP || WDF_ALL(WDF(1), vFrame))
+		) {
+			vParent.dwFields |= WDF(1);
+		}
+		break;
+
+	case WDC_RESPONSE:
+		CompleteResponse();
+
+		// The payload was a JSON object, which is all the channel
+		// requires; a response that could not be decoded is dropped.
+
+		vParent.dwFields |= WDF(1);
+		break;
+
+	case WDC_PAYLOAD:
+		CompletePayload();
+		break;
+
+	case WDC_WAVES:
+		((CWaveResponseStartListening *)vParent.lpObject)->m_lpWaves = (CWaveCollection *)vFrame.lpObject;
+		break;
+
+	case WDC_WAVE:
+		{
+			CWave * lpWave = (CWave *)vFrame.lpObject;
+
+			m_fHashing = FALSE;
+
+			if (WDF_ALL(WDF(1) | WDF(4) | WDF(6) | WDF(8) | WDF(9), vFrame))
+			{
+				TWaveDecoderHashMapIter pos = m_vHashes.find(lpWave->GetID());
+
+				if (pos != m_vHashes.end() && pos->second.uHash == m_uHash)
+				{
+					// The wave is the same as the last one with this ID, so
+					// the wave that was decoded then is sent instead. The
+					// view already holds that object and sees that nothing
+					// changed.
+
+					lpWave->Release();
+
+					lpWave = pos->second.lpWave;
+					lpWave->AddRef();
+
+					InterlockedIncrement(&m_lReusedWaves);
+				}
+				else
+				{
+					// The contacts may come after the messages, so the messages
+					// are resolved once the wave is complete.
+
+					for (TWaveMessageVectorIter iter = lpWave->m_vMessages.begin(); iter != lpWave->m_vMessages.end(); iter++)
+					{
+						(*iter)->ResolveContact(lpWave);
+					}
+
+					lpWave->UpdateFingerprints();
+					lpWave->CompactMessages();
+
+					if (pos != m_vHashes.end())
+					{
+						pos->second.lpWave->Release();
+					}
+
+					WAVE_DECODER_HASH & vHash = m_vHashes[lpWave->GetID()];
+
+					vHash.uHash = m_uHash;
+					vHash.lpWave = lpWave;
+
+					lpWave->AddRef();
+
+					InterlockedIncrement(&m_lDecodedWaves);
+				}
+
+				((CWaveCollection *)vParent.lpObject)->AddWave(lpWave);
+			}
+			else
+			{
+				FailResponse();
+
+				lpWave->Release();
+			}
+		}
+		break;
+
+	case WDC_WAVE_TIME:
+		if (WDF_ALL(WDF(0) | WDF(1), vFrame))
+		{
+			((CWave *)vFrame.lpObject)->m_dtTime = CWave::CreateDateTime(m_uTimeMajor, m_uTimeMinor);
+			vParent.dwFields |= WDF(8);
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_WAVE_SUBJECT:
+		if (WDF_ALL(WDF(1), vFrame))
+		{
+			vParent.dwFields |= WDF(9);
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_MESSAGE:
+		{
+			CWaveMessage * lpMessage = (CWaveMessage *)vFrame.lpObject;
+
+			if (WDF_ALL(WDF(1) | WDF(6), vFrame))
+			{
+				lpMessage->m_uOrder = vParent.uIndex;
+
+				lpMessage->Complete();
+
+				((CWave *)vParent.lpObject)->m_vMessages.push_back(lpMessage);
+			}
+			else
+			{
+				FailResponse();
+
+				delete lpMessage;
+			}
+		}
+		break;
+
+	case WDC_CONTACTS:
+		if (m_nResponseType == WMT_GET_ALL_CONTACTS)
+		{
+			((CWaveResponseGetAllContacts *)vParent.lpObject)->m_lpContacts = (CWaveContactCollection *)vFrame.lpObject;
+		}
+		else
+		{
+			((CWaveResponseGetContactDetails *)vParent.lpObject)->m_lpContacts = (CWaveContactCollection *)vFrame.lpObject;
+		}
+		break;
+
+	case WDC_CONTACT:
+		{
+			// Detect whether we're reading the "all contacts" list or the "get contact
+			// details" list.
+
+			CWaveContact * lpContact;
+
+			if (WDF_ALL(WDF(8), vFrame))
+			{
+				lpContact = (CWaveContact *)vFrame.lpObject;
+
+				if (!CompleteContact(vFrame))
+				{
+					delete lpContact;
+
+					lpContact = NULL;
+				}
+
+				if (vFrame.lpChild != NULL)
+				{
+					delete (CWaveContact *)vFrame.lpChild;
+				}
+			}
+			else
+			{
+				lpContact = (CWaveContact *)vFrame.lpChild;
+
+				delete (CWaveContact *)vFrame.lpObject;
+			}
+
+			if (lpContact == NULL)
+			{
+				FailResponse();
+			}
+			else
+			{
+				lpContact->Complete();
+
+				((CWaveContactCollection *)vParent.lpObject)->AddContact(lpContact);
+			}
+		}
+		break;
+
+	case WDC_CONTACT_DETAILS:
+		if (CompleteContact(vFrame))
+		{
+			vParent.lpChild = vFrame.lpObject;
+		}
+		else
+		{
+			delete (CWaveContact *)vFrame.lpObject;
+		}
+		break;
+
+	case WDC_NAME:
+		if (WDF_ALL(WDF(1) | WDF(2), vFrame))
+		{
+			((CWaveContact *)vParent.lpObject)->m_vNames.push_back((CWaveName *)vFrame.lpObject);
+		}
+		else
+		{
+			InvalidateContact();
+
+			delete (CWaveName *)vFrame.lpObject;
+		}
+		break;
+
+	case WDC_NAME_DETAILS:
+		if (WDF_ALL(WDF(1), vFrame))
+		{
+			vParent.dwFields |= WDF(2);
+		}
+		else
+		{
+			InvalidateContact();
+		}
+		break;
+
+	case WDC_STATUSES:
+		((CWaveResponseContactUpdates *)vParent.lpObject)->m_lpStatuses = (CWaveContactStatusCollection *)vFrame.lpObject;
+		break;
+
+	case WDC_STATUSES_EMPTY:
+		if (WDF_ALL(WDF(1), vFrame))
+		{
+			((CWaveResponseContactUpdates *)vParent.lpObject)->m_lpStatuses = new CWaveContactStatusCollection();
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_STATUS:
+		{
+			CWaveContactStatus * lpStatus = (CWaveContactStatus *)vFrame.lpObject;
+
+			if (WDF_ALL(WDF(2) | WDF(3), vFrame))
+			{
+				TWaveContactStatusMap & vStatuses = ((CWaveContactStatusCollection *)vParent.lpObject)->m_vStatuses;
+				TWaveContactStatusMapIter pos = vStatuses.find(lpStatus->m_szEmailAddress);
+
+				if (pos != vStatuses.end())
+				{
+					delete pos->second;
+				}
+
+				vStatuses[lpStatus->m_szEmailAddress] = lpStatus;
+			}
+			else
+			{
+				FailResponse();
+
+				delete lpStatus;
+			}
+		}
+		break;
+
+	case WDC_STATUS_CONTACT:
+		if (WDF_ALL(WDF(1), vFrame))
+		{
+			vParent.dwFields |= WDF(2);
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+
+	case WDC_STATUS_DETAILS:
+		if (WDF_ALL(WDF(2), vFrame))
+		{
+			vParent.dwFields |= WDF(3);
+		}
+		else
+		{
+			FailResponse();
+		}
+		break;
+	}
+}
+
+void CWaveDecoder::CompletePayload()
+{
+	// Collections that were missing from the payload are read as empty
+	// collections.
+
+	switch (m_nResponseType)
+	{
+	case WMT_START_LISTENING:
+		{
+			CWaveResponseStartListening * lpResponse = (CWaveResponseStartListening *)m_lpResponse;
+
+			if (lpResponse->m_lpWaves == NULL)
+			{
+				lpResponse->m_lpWaves = new CWaveCollection();
+			}
+
+			PruneWaves();
+		}
+		break;
+
+	case WMT_GET_ALL_CONTACTS:
+		{
+			CWaveResponseGetAllContacts * lpResponse = (CWaveResponseGetAllContacts *)m_lpResponse;
+
+			if (lpResponse->m_lpContacts == NULL)
+			{
+				lpResponse->m_lpContacts = new CWaveContactCollection();
+			}
+		}
+		break;
+
+	case WMT_GET_CONTACT_DETAILS:
+		{
+			CWaveResponseGetContactDetails * lpResponse = (CWaveResponseGetContactDetails *)m_lpResponse;
+
+			if (lpResponse->m_lpContacts == NULL)
+			{
+				lpResponse->m_lpContacts = new CWaveContactCollection();
+			}
+		}
+		break;
+
+	case WMT_CONTACT_UPDATES:
+		// The statuses however are required.
+
+		if (((CWaveResponseContactUpdates *)m_lpResponse)->m_lpStatuses == NULL)
+		{
+			FailResponse();
+		}
+		break;
+	}
+}
+
+BOOL CWaveDecoder::CompleteContact(WAVE_DECODER_FRAME & vFrame)
+{
+	if (vFrame.fInvalid || !WDF_ALL(WDF(8), vFrame))
+	{
+		return FALSE;
+	}
+
+	CWaveContact * lpContact = (CWaveContact *)vFrame.lpObject;
+
+	if (!WDF_ALL(WDF(1), vFrame))
+	{
+		lpContact->m_szName = lpContact->m_szEmailAddress;
+	}
+
+	return TRUE;
+}
+
+void CWaveDecoder::CompleteResponse()
+{
+	// When the payload came before the type, it was read into a value
+	// and is decoded now the type is known.
+
+	if (m_fHadType && m_fHadPayload && m_lpResponse == NULL && !m_fResponseFailed)
+	{
+		m_lpResponse = CWaveResponse::Create(m_nResponseType);
+
+		if (m_lpResponse != NULL && !m_lpResponse->AssignJson(m_vPayloadArena.root()))
+		{
+			m_fResponseFailed = TRUE;
+		}
+	}
+
+	if (m_fResponseFailed)
+	{
+		LOG("Could not parse json");
+	}
+
+	if (m_fResponseFailed || !m_fHadType || !m_fHadPayload)
+	{
+		if (m_lpResponse != NULL)
+		{
+			delete m_lpResponse;
+		}
+	}
+	else if (m_lpResponse != NULL && m_lpItem != NULL)
+	{
+		m_lpResponse->m_szRequestID = m_szRequestID;
+		m_lpResponse->m_fIsFinal = m_fFinal;
+
+		m_lpItem->m_lpResponse = m_lpResponse;
+	}
+	else if (m_lpResponse != NULL)
+	{
+		delete m_lpResponse;
+	}
+
+	m_lpResponse = NULL;
+	m_vPayloadArena.clear();
+}
+
+void CWaveDecoder::BeginPayload(WAVE_DECODER_VALUE nValue)
+{
+	BOOL fContainer = nValue == WDV_OBJECT || nValue == WDV_ARRAY;
+
+	if (m_fHadPayload)
+	{
+		if (fContainer)
+		{
+			PushFrame(WDC_SKIP);
+		}
+
+		return;
+	}
+
+	m_fHadPayload = TRUE;
+
+	if (!m_fHadType)
+	{
+		// The type is needed to decode the payload. Read the payload
+		// into the arena and decode it when the response is complete.
+
+		m_vPayloadArena.clear();
+		m_lpPayloadBuilder = new Json::ValueBuilder(m_vPayloadArena);
+		m_nPayloadDepth = 0;
+
+		return;
+	}
+
+	if (m_fResponseFailed)
+	{
+		if (fContainer)
+		{
+			PushFrame(WDC_SKIP);
+		}
+
+		return;
+	}
+
+	m_lpResponse = CWaveResponse::Create(m_nResponseType);
+
+	if (m_lpResponse == NULL || m_nResponseType == WMT_STOP_LISTENING)
+	{
+		// Ignore any incoming details, no feedback is required.
+
+		if (fContainer)
+		{
+			PushFrame(WDC_SKIP);
+		}
+
+		return;
+	}
+
+	if (nValue == WDV_NULL)
+	{
+		CompletePayload();
+
+		return;
+	}
+
+	if (nValue != WDV_OBJECT)
+	{
+		FailResponse();
+
+		if (fContainer)
+		{
+			PushFrame(WDC_SKIP);
+		}
+
+		return;
+	}
+
+	PushFrame(WDC_PAYLOAD, m_lpResponse);
+}
+
+void CWaveDecoder::EndPayload()
+{
+	ASSERT(m_lpPayloadBuilder != NULL);
+
+	delete m_lpPayloadBuilder;
+
+	m_lpPayloadBuilder = NULL;
+	m_nPayloadDepth = 0;
+}
+
+void CWaveDecoder::FailResponse()
+{
+	m_fResponseFailed = TRUE;
+}
+
+void CWaveDecoder::InvalidateContact()
+{
+	// Errors in a contact only matter when the contact is used, so they
+	// are recorded on the contact itself.
+
+	for (TWaveDecoderFrameVector::reverse_iterator iter = m_vFrames.rbegin(); iter != m_vFrames.rend(); iter++)
+	{
+		if (iter->nContext == WDC_CONTACT || iter->nContext == WDC_CONTACT_DETAILS)
+		{
+			iter->fInvalid = TRUE;
+
+			return;
+		}
+	}
+
+	FailResponse();
+}
+
+void CWaveDecoder::DeleteFrameObject(WAVE_DECODER_FRAME & vFrame)
+{
+	switch (vFrame.nContext)
+	{
+	case WDC_WAVES:
+		delete (CWaveCollection *)vFrame.lpObject;
+		break;
+
+	case WDC_WAVE:
+		((CWave *)vFrame.lpObject)->Release();
+		break;
+
+	case WDC_MESSAGE:
+		delete (CWaveMessage *)vFrame.lpObject;
+		break;
+
+	case WDC_CONTACTS:
+		delete (CWaveContactCollection *)vFrame.lpObject;
+		break;
+
+	case WDC_CONTACT:
+		delete (CWaveContact *)vFrame.lpObject;
+
+		if (vFrame.lpChild != NULL)
+		{
+			delete (CWaveContact *)vFrame.lpChild;
+		}
+		break;
+
+	case WDC_CONTACT_DETAILS:
+		delete (CWaveContact *)vFrame.lpObject;
+		break;
+
+	case WDC_NAME:
+		delete (CWaveName *)vFrame.lpObject;
+		break;
+
+	case WDC_STATUSES:
+		delete (CWaveContactStatusCollection *)vFrame.lpObject;
+		break;
+
+	case WDC_STATUS:
+		delete (CWaveContactStatus *)vFrame.lpObject;
+		break;
+	}
+}
+
+void CWaveDecoder::Hash(CHAR cType, LPCVOID lpData, size_t cbData)
+{
+	if (!m_fHashing)
+	{
+		return;
+	}
+
+	// The events of the wave are hashed with the same FNV-1a hash as the
+	// messages. Every event starts with its type and variable length
+	// data is preceded by its length, so different JSON cannot produce
+	// the same sequence of bytes.
+
+	ULONGLONG uHash = m_uHash;
+
+	uHash ^= (BYTE)cType;
+	uHash *= WAVE_FINGERPRINT_PRIME;
+
+	if (lpData != NULL)
+	{
+		LPBYTE lpBytes = (LPBYTE)&cbData;
+
+		for (size_t i = 0; i < sizeof(cbData); i++)
+		{
+			uHash ^= lpBytes[i];
+			uHash *= WAVE_FINGERPRINT_PRIME;
+		}
+
+		lpBytes = (LPBYTE)lpData;
+
+		for (size_t j = 0; j < cbData; j++)
+		{
+			uHash ^= lpBytes[j];
+			uHash *= WAVE_FINGERPRINT_PRIME;
+		}
+	}
+
+	m_uHash = uHash;
+}
+
+void CWaveDecoder::ForgetWave(const wstring & szID)
+{
+	TWaveDecoderHashMapIter pos = m_vHashes.find(szID);
+
+	if (pos != m_vHashes.end())
+	{
+		pos->second.lpWave->Release();
+
+		m_vHashes.erase(pos);
+	}
+}
+
+void CWaveDecoder::PruneWaves()
+{
+	// A wave that only the decoder still holds has left the view and is
+	// not in a response on its way there, so it is not worth keeping.
+	// The waves of the response that is being completed are held by the
+	// response and stay.
+
+	TWaveDecoderHashMapIter iter = m_vHashes.begin();
+
+	while (iter != m_vHashes.end())
+	{
+		if (iter->second.lpWave->GetRefCount() == 1)
+		{
+			iter->second.lpWave->Release();
+
+			m_vHashes.erase(iter++);
+		}
+		else
+		{
+			iter++;
+		}
+	}
+}
@@ -20,19 +20,15 @@
 #include "wave.h"
 
 CWaveMessage::CWaveMessage() :
+	m_lpEmailAddress(CStringPool::GetEmpty()),
 	m_uContactId(0),
-	m_uOrder(0)
+	m_uOrder(0),
+	m_uFingerprint(0),
+	m_uLength(0),
+	m_fBlank(TRUE)
 {
 }
 
-CWaveMessage::CWaveMessage(const CWaveMessage & _Other)
-{
-	m_szText = _Other.m_szText;
-	m_szEmailAddress = _Other.m_szEmailAddress;
-	m_uContactId = _Other.m_uContactId;
-	m_uOrder = _Other.m_uOrder;
-}
-
 CWaveMessage * CWaveMessage::CreateFromJson(Json::Value & vRoot, UINT uOrder)
 {
 	CWaveMessage * lpResult = new CWaveMessage();
@@ -58,6 +54,8 @@ CWaveMessage * CWaveMessage::CreateFromJson(Json::Value & vRoot, UINT uOrder)
 		lpResult->m_uContactId = vContactId.asUInt();
 		lpResult->m_uOrder = uOrder;
 
+		lpResult->Complete();
+
 		return lpResult;
 	}
 
@@ -73,10 +71,71 @@ void CWaveMessage::ResolveContact(CWave * lpWave)
 {
 	ASSERT(lpWave != NULL);
 
-	const TStringVector & vContacts = lpWave->GetContacts();
+	// The contacts of the wave are interned, so the message shares the
+	// email address with every other message of the same contact.
+
+	const TInternedVector & vContacts = lpWave->GetContacts();
 
 	if (m_uContactId < vContacts.size())
 	{
-		m_szEmailAddress = vContacts[m_uContactId];
+		m_lpEmailAddress = vContacts[m_uContactId];
+	}
+}
+
+void CWaveMessage::Complete()
+{
+	// The fingerprint, the length and whether the message is blank are
+	// taken from the full text; this is all the unread waves are diffed
+	// on. After that only the part of the text a popup can show is kept.
+
+	UpdateFingerprint();
+
+	m_uLength = m_szText.length();
+
+	// Trim would copy the whole text; we only need to know whether
+	// there is anything other than white space.
+
+	m_fBlank = TRUE;
+
+	for (wstring::const_iterator iter = m_szText.begin(); iter != m_szText.end(); iter++)
+	{
+		if (!iswspace(*iter))
+		{
+			m_fBlank = FALSE;
+			break;
+		}
 	}
+
+	if (m_uLength > WAVE_MESSAGE_MAX_TEXT)
+	{
+		wstring(m_szText, 0, WAVE_MESSAGE_MAX_TEXT).swap(m_szText);
+	}
+}
+
+void CWaveMessage::UpdateFingerprint()
+{
+	// The fingerprint is a 64-bit FNV-1a hash of the contact ID and the
+	// text, the fields that make two messages equal. Messages with
+	// different fingerprints are never equal, so comparing the
+	// fingerprints first avoids comparing the texts.
+
+	ULONGLONG uHash = WAVE_FINGERPRINT_BASIS;
+
+	LPBYTE lpData = (LPBYTE)&m_uContactId;
+
+	for (size_t i = 0; i < sizeof(m_uContactId); i++)
+	{
+		uHash ^= lpData[i];
+		uHash *= WAVE_FINGERPRINT_PRIME;
+	}
+
+	lpData = (LPBYTE)m_szText.c_str();
+
+	for (size_t j = 0; j < m_szText.length() * sizeof(WCHAR); j++)
+	{
+		uHash ^= lpData[j];
+		uHash *= WAVE_FINGERPRINT_PRIME;
+	}
+
+	m_uFingerprint = uHash;
 }
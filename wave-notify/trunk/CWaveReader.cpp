@@ -19,13 +19,32 @@
 #include "include.h"
 #include "wave.h"
 
+CWaveReader::~CWaveReader()
+{
+	if (m_hTrace != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hTrace);
+	}
+}
+
 BOOL CWaveReader::Read(LPBYTE lpData, DWORD cbData)
 {
 	ASSERT(lpData != NULL && cbData > 0);
 
-	m_szBuffer << m_vConverter.Parse(lpData, cbData);
+#if defined(_DEBUG) && defined(TEST_CHANNEL_TRACE)
+	if (m_fTrace)
+	{
+		TraceChunk(lpData, cbData);
+	}
+#endif
+
+	m_szBuffer.append((LPCSTR)lpData, cbData);
+
+	BOOL fSuccess = PumpResponseBuffer();
+
+	CompactBuffer();
 
-	return PumpResponseBuffer();
+	return fSuccess;
 }
 
 BOOL CWaveReader::PumpResponseBuffer()
@@ -40,33 +59,88 @@ BOOL CWaveReader::PumpResponseBuffer()
 
 BOOL CWaveReader::PumpMessage(BOOL & fSuccess)
 {
-	wstring szReceived = m_szBuffer.str();
+	switch (m_nState)
+	{
+	case WRS_LENGTH:
+		return ReadLength(fSuccess);
+
+	case WRS_PAYLOAD:
+		return ReadPayload(fSuccess);
+
+	default:
+		FAIL("Invalid reader state");
+
+		fSuccess = FALSE;
+		return FALSE;
+	}
+}
 
-	// Does the current content has a newline?
+BOOL CWaveReader::ReadLength(BOOL & fSuccess)
+{
+	// Only scan the part of the buffer we haven't seen yet. The length
+	// may be split over multiple reads and we don't want to go over
+	// the same digits again on every read.
 
-	DWORD dwPos = szReceived.find(L'\n');
+	size_t nPos = m_szBuffer.find('\n', m_nScanned);
 
-	if (dwPos == wstring::npos)
+	if (nPos == wstring::npos)
 	{
-		// No full packet in yet.
+		// No full length in yet.
+
+		m_nScanned = m_szBuffer.length();
 
 		fSuccess = TRUE;
 		return FALSE;
 	}
 
-	wstring szLength = szReceived.substr(0, dwPos);
-
-	if (szLength.length() == 0 || !iswdigit(szLength))
+	if (nPos == m_nOffset)
 	{
-		// The first line was not a number; we cannot read a package.
+		// The first line was empty; we cannot read a package.
 
 		fSuccess = FALSE;
 		return FALSE;
 	}
 
-	DWORD dwLength = _wtol(szLength.c_str());
+	size_t nLength = 0;
+
+	for (size_t i = m_nOffset; i < nPos; i++)
+	{
+		CHAR c = m_szBuffer[i];
+
+		if (c < '0' || c > '9')
+		{
+			// The first line was not a number; we cannot read a package.
+
+			fSuccess = FALSE;
+			return FALSE;
+		}
+
+		nLength = nLength * 10 + (c - '0');
+	}
+
+	m_nPayloadOffset = nPos + 1;
+	m_nPayloadRemaining = nLength;
+	m_nScanned = m_nPayloadOffset;
+	m_nState = WRS_PAYLOAD;
 
-	if (szReceived.length() < dwPos + 1 + dwLength)
+	fSuccess = TRUE;
+	return TRUE;
+}
+
+BOOL CWaveReader::ReadPayload(BOOL & fSuccess)
+{
+	// The length of the package is in characters, but the buffer
+	// contains the raw UTF-8 bytes. Continue counting characters from
+	// where the previous read stopped.
+
+	LPCSTR szBuffer = m_szBuffer.c_str();
+
+	m_nScanned = SkipCharacters(
+		szBuffer + m_nScanned,
+		szBuffer + m_szBuffer.length(),
+		m_nPayloadRemaining) - szBuffer;
+
+	if (m_nPayloadRemaining > 0)
 	{
 		// No full packet in yet.
 
@@ -75,24 +149,135 @@ BOOL CWaveReader::PumpMessage(BOOL & fSuccess)
 	}
 
 	// We have received a full package; parse to a response and submit.
+	// The package is handed to the session as a range of the buffer so
+	// we don't have to copy it out.
 
-	fSuccess = m_lpSession->ParseChannelResponse(szReceived.substr(dwPos + 1, dwLength));
+	if (m_lpReplay != NULL)
+	{
+		fSuccess = m_lpReplay->ParseChannelResponse(szBuffer + m_nPayloadOffset, szBuffer + m_nScanned);
+	}
+	else
+	{
+		fSuccess = m_lpSession->ParseChannelResponse(szBuffer + m_nPayloadOffset, szBuffer + m_nScanned);
+	}
 
-	m_szBuffer.str(L"");
+	m_nOffset = m_nScanned;
+	m_nState = WRS_LENGTH;
 
 	if (!fSuccess)
 	{
 		return FALSE;
 	}
 
-	if (szReceived.length() > dwPos + 1 + dwLength)
+	return m_nOffset < m_szBuffer.length();
+}
+
+void CWaveReader::CompactBuffer()
+{
+	// Everything before the offset has been processed. We only move
+	// the remainder to the front of the buffer when the processed part
+	// becomes the larger part, so the cost of moving stays linear in
+	// the amount of data received. The capacity of the buffer is kept
+	// so it is reused for the following reads.
+
+	if (m_nOffset == 0)
 	{
-		m_szBuffer << szReceived.substr(dwPos + 1 + dwLength);
+		return;
+	}
 
-		return TRUE;
+	if (m_nOffset == m_szBuffer.length())
+	{
+		m_szBuffer.erase();
+	}
+	else if (m_nOffset >= m_szBuffer.length() - m_nOffset)
+	{
+		m_szBuffer.erase(0, m_nOffset);
 	}
 	else
 	{
-		return FALSE;
+		return;
 	}
+
+	m_nScanned -= m_nOffset;
+	m_nPayloadOffset -= min(m_nPayloadOffset, m_nOffset);
+	m_nOffset = 0;
+}
+
+void CWaveReader::TraceChunk(LPBYTE lpData, DWORD cbData)
+{
+	ASSERT(lpData != NULL && cbData > 0);
+
+	// Every chunk is written with the time it was read and its length,
+	// so a replay gets the same chunk boundaries. A channel request
+	// starts with an empty chunk; the replay starts a new reader there.
+
+	WAVE_TRACE_CHUNK vChunk;
+	DWORD dwWritten;
+
+	if (m_hTrace == INVALID_HANDLE_VALUE)
+	{
+		m_hTrace = CreateFile(
+			WAVE_CHANNEL_TRACE,
+			GENERIC_WRITE,
+			FILE_SHARE_READ,
+			NULL,
+			OPEN_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL,
+			NULL);
+
+		if (m_hTrace == INVALID_HANDLE_VALUE)
+		{
+			LOG("Could not open the channel trace");
+
+			m_fTrace = FALSE;
+			return;
+		}
+
+		SetFilePointer(m_hTrace, 0, 0, FILE_END);
+
+		vChunk.dwTime = GetTickCount();
+		vChunk.cbData = 0;
+
+		WriteFile(m_hTrace, &vChunk, sizeof(WAVE_TRACE_CHUNK), &dwWritten, NULL);
+	}
+
+	vChunk.dwTime = GetTickCount();
+	vChunk.cbData = cbData;
+
+	WriteFile(m_hTrace, &vChunk, sizeof(WAVE_TRACE_CHUNK), &dwWritten, NULL);
+	WriteFile(m_hTrace, lpData, cbData, &dwWritten, NULL);
+}
+
+LPCSTR CWaveReader::SkipCharacters(LPCSTR szBegin, LPCSTR szEnd, size_t & nCharacters)
+{
+	ASSERT(szBegin != NULL && szEnd >= szBegin);
+
+	// Characters are counted the way they end up in a wstring, so
+	// characters outside of the BMP count as two. A character is only
+	// skipped when all its bytes are available.
+
+	LPCSTR szCurrent = szBegin;
+
+	while (nCharacters > 0 && szCurrent < szEnd)
+	{
+		INT nTrailingBytes = CUTF8Converter::GetTrailingBytes((BYTE)*szCurrent);
+
+		if (szEnd - szCurrent <= nTrailingBytes)
+		{
+			break;
+		}
+
+		szCurrent += nTrailingBytes + 1;
+
+		if (nTrailingBytes == 3 && nCharacters > 1)
+		{
+			nCharacters -= 2;
+		}
+		else
+		{
+			nCharacters--;
+		}
+	}
+
+	return szCurrent;
 }
@@ -36,3 +36,40 @@ void CWaveRequestGetContactDetails::CreateRequest(Json::Value & vRoot)
 		nOffset++;
 	}
 }
+
+BOOL CWaveRequestGetContactDetails::Merge(CWaveRequest * lpRequest)
+{
+	ASSERT(lpRequest != NULL);
+
+	if (lpRequest->GetType() != GetType())
+	{
+		return FALSE;
+	}
+
+	// Addresses we already ask for are dropped from the later request, and
+	// new ones are taken over while this request has room for them.
+
+	TStringVector & vEmailAddresses = ((CWaveRequestGetContactDetails *)lpRequest)->m_vEmailAddresses;
+
+	TStringVectorIter iter = vEmailAddresses.begin();
+
+	while (iter != vEmailAddresses.end())
+	{
+		if (find(m_vEmailAddresses.begin(), m_vEmailAddresses.end(), *iter) != m_vEmailAddresses.end())
+		{
+			iter = vEmailAddresses.erase(iter);
+		}
+		else if (m_vEmailAddresses.size() < WAVE_CONTACT_DETAILS_MAX)
+		{
+			m_vEmailAddresses.push_back(*iter);
+
+			iter = vEmailAddresses.erase(iter);
+		}
+		else
+		{
+			iter++;
+		}
+	}
+
+	return vEmailAddresses.empty();
+}
@@ -33,3 +33,23 @@ void CWaveRequestStopListening::RequestCompleted()
 {
 	CNotifierApp::Instance()->GetSession()->RemoveListener(m_szID);
 }
+
+BOOL CWaveRequestStopListening::Merge(CWaveRequest * lpRequest)
+{
+	ASSERT(lpRequest != NULL);
+
+	return
+		lpRequest->GetType() == GetType() &&
+		((CWaveRequestStopListening *)lpRequest)->m_szID == m_szID;
+}
+
+BOOL CWaveRequestStopListening::Cancels(CWaveRequest * lpRequest)
+{
+	ASSERT(lpRequest != NULL);
+
+	// A listener that is stopped before it was started is never posted.
+
+	return
+		lpRequest->GetType() == WMT_START_LISTENING &&
+		((CWaveRequestStartListening *)lpRequest)->GetListenerID() == m_szID;
+}
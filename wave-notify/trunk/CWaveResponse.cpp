@@ -81,28 +81,7 @@ CWaveResponse * CWaveResponse::Parse(Json::Value & vRoot)
 
 	if (fHadType && fHadPayload)
 	{
-		switch (nType)
-		{
-		case WMT_GET_ALL_CONTACTS:
-			lpResponse = new CWaveResponseGetAllContacts();
-			break;
-
-		case WMT_START_LISTENING:
-			lpResponse = new CWaveResponseStartListening();
-			break;
-
-		case WMT_GET_CONTACT_DETAILS:
-			lpResponse = new CWaveResponseGetContactDetails();
-			break;
-
-		case WMT_STOP_LISTENING:
-			lpResponse = new CWaveResponseStopListening();
-			break;
-
-		case WMT_CONTACT_UPDATES:
-			lpResponse = new CWaveResponseContactUpdates();
-			break;
-		}
+		lpResponse = Create(nType);
 	}
 
 	if (lpResponse != NULL)
@@ -121,6 +100,30 @@ CWaveResponse * CWaveResponse::Parse(Json::Value & vRoot)
 	return lpResponse;
 }
 
+CWaveResponse * CWaveResponse::Create(WAVE_MESSAGE_TYPE nType)
+{
+	switch (nType)
+	{
+	case WMT_GET_ALL_CONTACTS:
+		return new CWaveResponseGetAllContacts();
+
+	case WMT_START_LISTENING:
+		return new CWaveResponseStartListening();
+
+	case WMT_GET_CONTACT_DETAILS:
+		return new CWaveResponseGetContactDetails();
+
+	case WMT_STOP_LISTENING:
+		return new CWaveResponseStopListening();
+
+	case WMT_CONTACT_UPDATES:
+		return new CWaveResponseContactUpdates();
+
+	default:
+		return NULL;
+	}
+}
+
 BOOL CWaveResponse::ReadStringArray(TStringVector & vStrings, Json::Value & vRoot)
 {
 	if (!vRoot.isArray())
@@ -19,6 +19,7 @@
 #include "include.h"
 #include "wave.h"
 #include "notifierapp.h"
+#include "settings.h"
 
 CWaveSession::CWaveSession(CWindowHandle * lpTargetWindow)
 {
@@ -33,15 +34,29 @@ CWaveSession::CWaveSession(CWindowHandle * lpTargetWindow)
 	m_nLoginError = WLE_SUCCESS;
 	m_lpRequest = NULL;
 	m_lpChannelRequest = NULL;
-	m_lpPostRequest = NULL;
 	m_nRequesting = WSR_NONE;
 	m_nState = WSS_OFFLINE;
 	m_nFlushSuspended = 0;
+	m_fResumingSession = FALSE;
+	m_uMaxQueuedRequests = 0;
 
 	m_lpReconnectTimer = new CTimer();
 
 	m_lpReconnectTimer->Tick += AddressOf<CWaveSession>(this, &CWaveSession::ReconnectTimer);
 
+	m_nReconnectTier = WRT_LOGIN;
+	m_nReconnectAttempts = 0;
+	m_dwReconnectStarted = 0;
+	m_nLastReconnectTier = WRT_LOGIN;
+	m_dwLastReconnectTime = 0;
+	m_dwLoginStarted = 0;
+	m_dwConnectTime = 0;
+	m_lChannelBytes = 0;
+
+	InitialiseChannelReader(m_vChannelReader);
+
+	m_lpChannelDecoder = new CWaveDecoder();
+
 	ResetChannelParameters();
 }
 
@@ -58,6 +73,7 @@ CWaveSession::~CWaveSession()
 	}
 
 	delete m_lpReconnectTimer;
+	delete m_lpChannelDecoder;
 }
 
 BOOL CWaveSession::Login(wstring szUsername, wstring szPassword)
@@ -77,12 +93,27 @@ BOOL CWaveSession::Login(wstring szUsername, wstring szPassword)
 	}
 
 	m_nState = WSS_CONNECTING;
+	m_dwLoginStarted = GetTickCount();
 
 	SignalProgress(WCS_BEGIN_LOGON);
 
 	m_szUsername = szUsername;
 	m_szPassword = szPassword;
 
+	// A session kept by an earlier run only needs a new SID. When the
+	// server does not accept it anymore, we log in as usual.
+
+	if (RestoreSessionState())
+	{
+		m_fResumingSession = TRUE;
+
+		ResetChannelParameters();
+
+		PostSIDRequest();
+
+		return TRUE;
+	}
+
 	return Reconnect();
 }
 
@@ -144,8 +175,24 @@ wstring CWaveSession::GetAuthKeyFromRequest(wstring & szResponse) const
 	}
 }
 
-void CWaveSession::SignOut()
+void CWaveSession::SignOut(BOOL fKeepSession)
 {
+	m_fResumingSession = FALSE;
+
+	// The channel may have refreshed the cookies since the SID, so the
+	// state is saved again. The session is only kept when it was saved;
+	// otherwise we log out as usual.
+
+	if (fKeepSession && m_nState == WSS_ONLINE)
+	{
+		fKeepSession = SaveSessionState();
+	}
+
+	if (!fKeepSession)
+	{
+		DeleteSessionState();
+	}
+
 	if (m_nState == WSS_RECONNECTING)
 	{
 		StopReconnecting();
@@ -156,17 +203,21 @@ void CWaveSession::SignOut()
 
 		SignalProgress(WCS_BEGIN_SIGNOUT);
 
-		if (m_lpPostRequest != NULL)
+		// The channel may be waiting to be reopened.
+
+		m_lpReconnectTimer->SetRunning(FALSE);
+
+		for (TWavePostVectorIter iter = m_vPosts.begin(); iter != m_vPosts.end(); iter++)
 		{
-			CNotifierApp::Instance()->CancelRequest(m_lpPostRequest);
+			CNotifierApp::Instance()->CancelRequest(iter->lpRequest);
 
 			// We do not need to flush the request queue anymore.
 
-			m_vOwnedRequests.push_back(m_lpPostRequest);
-
-			m_lpPostRequest = NULL;
+			m_vOwnedRequests.push_back(iter->lpRequest);
 		}
 
+		m_vPosts.clear();
+
 		if (m_lpChannelRequest != NULL)
 		{
 			CNotifierApp::Instance()->CancelRequest(m_lpChannelRequest);
@@ -178,7 +229,25 @@ void CWaveSession::SignOut()
 			m_lpChannelRequest = NULL;
 		}
 
-		PostSignOutRequest();
+		if (fKeepSession)
+		{
+			// Logging out would invalidate the cookies that were kept.
+
+			m_nState = WSS_OFFLINE;
+
+			if (m_lpCookies != NULL)
+			{
+				delete m_lpCookies;
+			}
+
+			m_lpCookies = NULL;
+
+			SignalProgress(WCS_SIGNED_OUT);
+		}
+		else
+		{
+			PostSignOutRequest();
+		}
 	}
 }
 
@@ -366,13 +435,16 @@ BOOL CWaveSession::ProcessCurlResponse(CCurl * lpCurl)
 		return FALSE;
 	}
 
-	// Is this the response from the post request?
+	// Is this the response from one of the post requests?
 
-	if (lpCurl == m_lpPostRequest)
+	for (TWavePostVectorConstIter iter = m_vPosts.begin(); iter != m_vPosts.end(); iter++)
 	{
-		ProcessPostResponse();
+		if (iter->lpRequest == lpCurl)
+		{
+			ProcessPostResponse(lpCurl);
 
-		return TRUE;
+			return TRUE;
+		}
 	}
 
 	// Is this response from the channel listener?
@@ -596,7 +668,7 @@ void CWaveSession::ProcessSIDResponse()
 {
 	ASSERT(m_lpRequest != NULL);
 
-	CCurlUTF8StringReader * lpReader = (CCurlUTF8StringReader *)m_lpRequest->GetReader();
+	CCurlBinaryReader * lpReader = (CCurlBinaryReader *)m_lpRequest->GetReader();
 
 	ASSERT(lpReader != NULL);
 	
@@ -606,11 +678,23 @@ void CWaveSession::ProcessSIDResponse()
 	{
 		SetCookies(m_lpRequest->GetCookies());
 
-		wstring szChannelResponse(ExtractChannelResponse(lpReader->GetString()));
+		LPCSTR szBegin;
+		LPCSTR szEnd;
 
-		if (!szChannelResponse.empty())
+		if (ExtractChannelResponse(lpReader->GetData(), szBegin, szEnd))
 		{
-			fSuccess = ParseChannelResponse(szChannelResponse);
+			// The reader thread may still be parsing frames of the channel
+			// that is being replaced, so the SID response gets its own
+			// reader and decoder.
+
+			Json::Reader vReader;
+			CWaveDecoder vDecoder;
+
+			InitialiseChannelReader(vReader);
+
+			InterlockedExchangeAdd(&m_lChannelBytes, (LONG)(szEnd - szBegin));
+
+			fSuccess = DecodeChannelResponse(vReader, vDecoder, szBegin, szEnd, FALSE);
 		}
 	}
 	
@@ -622,36 +706,86 @@ void CWaveSession::ProcessSIDResponse()
 
 	if (fSuccess)
 	{
+		// A new SID is also requested when reconnecting with the cookies
+		// we already have, in which case the session details were not
+		// requested and the state is still reconnecting.
+
+		BOOL fReconnecting = m_nState == WSS_RECONNECTING;
+
+		m_nState = WSS_ONLINE;
+
+		// The time to connected runs from the login to the first SID,
+		// including the retries of the login itself.
+
+		if (m_dwLoginStarted != 0)
+		{
+			m_dwConnectTime = GetTickCount() - m_dwLoginStarted;
+			m_dwLoginStarted = 0;
+		}
+
+		ReconnectCompleted();
+
+		// Neither a resumed session nor a reconnect with the cookies we
+		// already have went through the login, which signals the logon.
+
+		if (m_fResumingSession || fReconnecting)
+		{
+			m_fResumingSession = FALSE;
+
+			SignalProgress(WCS_LOGGED_ON);
+		}
+
+		SaveSessionState();
+
 		SignalProgress(WCS_CONNECTED);
 
 		PostChannelRequest();
 
 		FlushRequestQueue();
 	}
+	else if (m_fResumingSession)
+	{
+		// The kept session was not accepted; log in as usual.
+
+		m_fResumingSession = FALSE;
+
+		DeleteSessionState();
+
+		Reconnect();
+	}
+	else if (m_nState == WSS_RECONNECTING)
+	{
+		NextReconnect();
+	}
 	else
 	{
 		InitiateReconnect();
 	}
 }
 
-wstring CWaveSession::ExtractChannelResponse(wstring szResponse)
+BOOL CWaveSession::ExtractChannelResponse(const TByteVector & vResponse, LPCSTR & szBegin, LPCSTR & szEnd)
 {
-	if (!szResponse.empty())
+	if (!vResponse.empty())
 	{
-		DWORD dwPos = szResponse.find(L'\n');
+		LPCSTR szResponse = (LPCSTR)_VECTOR_DATA(vResponse);
+		LPCSTR szResponseEnd = szResponse + vResponse.size();
+		LPCSTR szPos = (LPCSTR)memchr(szResponse, '\n', vResponse.size());
 
-		if (dwPos != wstring::npos && dwPos > 0)
+		if (szPos != NULL && szPos > szResponse)
 		{
-			DWORD dwLength = _wtol(szResponse.substr(0, dwPos).c_str());
+			size_t nLength = atol(string(szResponse, szPos).c_str());
 
-			if (szResponse.length() >= dwPos + 1 + dwLength)
+			szBegin = szPos + 1;
+			szEnd = CWaveReader::SkipCharacters(szBegin, szResponseEnd, nLength);
+
+			if (nLength == 0 && szEnd > szBegin)
 			{
-				return szResponse.substr(dwPos + 1, dwLength);
+				return TRUE;
 			}
 		}
 	}
 
-	return L"";
+	return FALSE;
 }
 
 void CWaveSession::ProcessSignOutResponse()
@@ -675,13 +809,64 @@ void CWaveSession::ProcessSignOutResponse()
 	m_nRequesting = WSR_NONE;
 }
 
-void CWaveSession::ProcessPostResponse()
+void CWaveSession::ProcessPostResponse(CCurl * lpCurl)
 {
-	ASSERT(m_lpPostRequest != NULL);
+	ASSERT(lpCurl != NULL);
 
-	delete m_lpPostRequest;
-	
-	m_lpPostRequest = NULL;
+	TWavePostVectorIter pos = m_vPosts.begin();
+
+	while (pos != m_vPosts.end() && pos->lpRequest != lpCurl)
+	{
+		pos++;
+	}
+
+	ASSERT(pos != m_vPosts.end());
+
+	// A post that failed on the network or was not accepted by the server
+	// is sent again with the same RID. It is only sent again while the
+	// channel it was posted to is still in use.
+
+	BOOL fRetry =
+		m_nState == WSS_ONLINE &&
+		lpCurl->GetResult() != CURL_RESULT_CANCELLED &&
+		(lpCurl->GetResult() != CURLE_OK || lpCurl->GetStatus() != 200) &&
+		pos->nRetries < WAVE_POST_RETRIES;
+
+	if (fRetry)
+	{
+		m_vChannelLock.Enter();
+
+		fRetry = pos->szSID == m_szSID;
+
+		m_vChannelLock.Leave();
+	}
+
+	delete lpCurl;
+
+	if (fRetry)
+	{
+		pos->nRetries++;
+
+		// The posts after the failed one are still in flight and could
+		// reach the server before it. They are cancelled and sent again
+		// after it, so the server gets the posts in RID order.
+
+		for (TWavePostVectorIter iter = pos + 1; iter != m_vPosts.end(); iter++)
+		{
+			CNotifierApp::Instance()->CancelRequest(iter->lpRequest);
+
+			m_vOwnedRequests.push_back(iter->lpRequest);
+		}
+
+		for (TWavePostVectorIter iter1 = pos; iter1 != m_vPosts.end(); iter1++)
+		{
+			SendPost(*iter1);
+		}
+	}
+	else
+	{
+		m_vPosts.erase(pos);
+	}
 
 	FlushRequestQueue();
 }
@@ -695,13 +880,28 @@ void CWaveSession::ProcessChannelResponse()
 	ASSERT(lpReader != NULL);
 	
 	BOOL fSuccess = FALSE;
+	BOOL fRejected = FALSE;
 
-	fSuccess =
-		m_nState == WSS_ONLINE &&
-		(
-			m_lpChannelRequest->GetResult() == CURLE_OK ||
-			m_lpChannelRequest->GetResult() == CURLE_OPERATION_TIMEOUTED
-		);
+	// The result of the transfer is looked at first. A long poll that
+	// runs into its timeout is how an idle channel ends, so that is not
+	// a failure. Only a transfer that completed has a status; a channel
+	// with an SID the server no longer knows is answered with an error
+	// status.
+
+	if (m_nState == WSS_ONLINE)
+	{
+		switch (m_lpChannelRequest->GetResult())
+		{
+		case CURLE_OK:
+			fSuccess = m_lpChannelRequest->GetStatus() == 200;
+			fRejected = !fSuccess;
+			break;
+
+		case CURLE_OPERATION_TIMEOUTED:
+			fSuccess = TRUE;
+			break;
+		}
+	}
 
 	if (fSuccess)
 	{
@@ -718,13 +918,34 @@ void CWaveSession::ProcessChannelResponse()
 	{
 		// Continue the channel by posting the next request.
 
+		ReconnectCompleted();
+
 		PostChannelRequest();
 	}
 	else if (m_nState == WSS_ONLINE)
 	{
-		// Only automatically reconnect when we're online.
+		// Reopening the channel with an SID the server rejected is
+		// pointless, so the SID is dropped and reconnecting starts at
+		// requesting a new one.
 
-		InitiateReconnect();
+		if (fRejected)
+		{
+			m_vChannelLock.Enter();
+			m_szSID = L"";
+			m_vChannelLock.Leave();
+		}
+
+		// Only automatically reconnect when we're online. A channel that
+		// was reopened and failed again moves on to the next tier.
+
+		if (m_dwReconnectStarted != 0 && m_nReconnectTier == WRT_CHANNEL)
+		{
+			NextReconnect();
+		}
+		else
+		{
+			InitiateReconnect();
+		}
 	}
 }
 
@@ -797,7 +1018,7 @@ void CWaveSession::PostSIDRequest()
 	m_lpRequest->SetTimeout(WEB_TIMEOUT_SHORT);
 	m_lpRequest->SetIgnoreSSLErrors(TRUE);
 	m_lpRequest->SetCookies(GetCookies());
-	m_lpRequest->SetReader(new CCurlUTF8StringReader());
+	m_lpRequest->SetReader(new CCurlBinaryReader());
 
 	m_lpRequest->SetUrlEncodedPostData(L"count=0");
 
@@ -808,15 +1029,18 @@ void CWaveSession::PostSIDRequest()
 
 void CWaveSession::PostChannelRequest()
 {
-	if (m_lpRequest != NULL)
+	if (m_lpChannelRequest != NULL)
 	{
 		m_vOwnedRequests.push_back(m_lpChannelRequest);
 	}
 
-	m_lpChannelRequest = new CCurl(
-		Format(WAVE_URL_CHANNEL, m_szSID.c_str(), m_nAID, BuildHash().c_str()),
-		m_lpTargetWindow
-	);
+	m_vChannelLock.Enter();
+
+	wstring szUrl = Format(WAVE_URL_CHANNEL, m_szSID.c_str(), m_nAID, BuildHash().c_str());
+
+	m_vChannelLock.Leave();
+
+	m_lpChannelRequest = new CCurl(szUrl, m_lpTargetWindow);
 
 	m_lpChannelRequest->SetUserAgent(USERAGENT);
 	m_lpChannelRequest->SetTimeout(WEB_TIMEOUT_CHANNEL);
@@ -829,158 +1053,184 @@ void CWaveSession::PostChannelRequest()
 
 void CWaveSession::ResetChannelParameters()
 {
+	m_vChannelLock.Enter();
+
 	m_szSID = L"";
 	m_nAID = 0;
+
+	m_vChannelLock.Leave();
+
 	m_nRID = Rand(10000, 90000);
 	m_nNextRequestID = 0;
 	m_nNextListenerID = 0;
 }
 
-BOOL CWaveSession::ParseChannelResponse(wstring szResponse)
+void CWaveSession::InitialiseChannelReader(Json::Reader & vReader)
 {
-	Json::Reader vReader;
-	Json::Value vRoot;
+	// The wfe payloads are JSON documents encoded as strings. Parse them
+	// together with the channel frame instead of parsing them again. They
+	// only appear as the content of a channel item, e.g.
+	// [[aid,["wfe","..."]]], which is the third level of arrays.
+
+	vReader.setEmbeddedDocumentTag(L"wfe", 3);
+}
+
+BOOL CWaveSession::ParseChannelResponse(LPCSTR szBegin, LPCSTR szEnd)
+{
+	ASSERT(szBegin != NULL && szEnd >= szBegin);
+
+	// Frames of the channel are parsed on the reader thread of the curl
+	// monitor. The channel reader and decoder are only used from there.
+
+	InterlockedExchangeAdd(&m_lChannelBytes, (LONG)(szEnd - szBegin));
+
+	return DecodeChannelResponse(m_vChannelReader, *m_lpChannelDecoder, szBegin, szEnd, FALSE);
+}
+
+BOOL CWaveSession::ReplayChannelResponse(Json::Reader & vReader, CWaveDecoder & vDecoder, LPCSTR szBegin, LPCSTR szEnd)
+{
+	ASSERT(szBegin != NULL && szEnd >= szBegin);
+
+	// A replayed frame is parsed with the reader and decoder of the
+	// replay and only its responses are reported; the SID and AID of
+	// the session are left alone.
+
+	return DecodeChannelResponse(vReader, vDecoder, szBegin, szEnd, TRUE);
+}
+
+BOOL CWaveSession::DecodeChannelResponse(Json::Reader & vReader, CWaveDecoder & vDecoder, LPCSTR szBegin, LPCSTR szEnd, BOOL fReplay)
+{
+	ASSERT(szBegin != NULL && szEnd >= szBegin);
+
+	// The frame is parsed straight from the buffer of the reader so
+	// the payload does not have to be copied into a separate string.
+	// The decoder builds the responses while the frame is being parsed,
+	// so no intermediate Json::Value tree is built.
+	//
+	// The SID and AID are shared between the UI thread and the reader
+	// thread and only touched under the channel lock; responses are
+	// posted to the UI thread.
+	//
+	// The responses are fully built here. Once posted, the decoding
+	// thread does not touch them anymore; the UI thread only merges
+	// them into its view.
+
+	vDecoder.Reset();
 
 	if (
-		!vReader.parse(szResponse, vRoot) &&
-		!vRoot.isArray()
+		!vReader.parse(szBegin, szEnd, vDecoder) ||
+		!vDecoder.IsFrame()
 	) {
 		LOG("Could not parse json");
 
+		vDecoder.Reset();
+
 		return FALSE;
 	}
 
 	BOOL fSuccess = TRUE;
 
-	for (DWORD i = 0; i < vRoot.size(); i++)
-	{
-		fSuccess = FALSE;
+	const TWaveChannelItemVector & vItems = vDecoder.GetItems();
 
-		Json::Value & vItem = vRoot[i];
+	for (TWaveChannelItemVectorConstIter iter = vItems.begin(); iter != vItems.end(); iter++)
+	{
+		CWaveChannelItem * lpItem = *iter;
 
-		if (!vItem.isArray())
+		if (!lpItem->GetSuccess())
 		{
 			LOG("Could not parse json");
 
-			break;
-		}
-
-		Json::Value & vAID = vItem[0u];
-		Json::Value & vContent = vItem[1];
-
-		if (
-			!vAID.isIntegral() ||
-			!vContent.isArray()
-		) {
-			LOG("Could not parse json");
+			fSuccess = FALSE;
 
 			break;
 		}
 
-		Json::Value & vType = vContent[0u];
-
-		if (!vType.isString())
+		switch (lpItem->GetType())
 		{
-			LOG("Could not parse json");
-
-			break;
-		}
-
-		INT nAID = vAID.asInt();
-		wstring szType = vType.asString();
-
-		if (szType == L"c")
-		{
-			if (vContent.size() > 1)
+		case WCIT_SID:
+			if (!fReplay)
 			{
-				Json::Value & vSID = vContent[1];
-
-				if (vSID.isString())
-				{
-					m_szSID = vSID.asString();
-
-					fSuccess = TRUE;
-				}
-				else
-				{
-					LOG("Could not parse json");
-				}
+				m_vChannelLock.Enter();
+				m_szSID = lpItem->GetSID();
+				m_vChannelLock.Leave();
 			}
-		}
-		else if (szType == L"wfe")
-		{
-			if (vContent.size() > 1)
-			{
-				Json::Value & vPayload = vContent[1];
+			break;
 
-				if (vPayload.isString())
-				{
-					CWaveResponse * lpResponse =
-						ParseWfeResponse(vPayload.asString(), fSuccess);
+		case WCIT_RESPONSE:
+			{
+				CWaveResponse * lpResponse = lpItem->DetachResponse();
 
-					if (fSuccess && lpResponse != NULL)
-					{
-						ReportReceived(lpResponse);
-					}
-				}
-				else
+				if (lpResponse != NULL)
 				{
-					LOG("Could not parse json");
+					ReportReceived(lpResponse);
 				}
 			}
-		}
-		else
-		{
-			// There are noop's being sent, but everything else is also
-			// ignored.
-
-			fSuccess = TRUE;
+			break;
 		}
 
-		if (fSuccess)
-		{
-			m_nAID = nAID;
-		}
-		else
+		if (!fReplay)
 		{
-			break;
+			m_vChannelLock.Enter();
+			m_nAID = lpItem->GetAID();
+			m_vChannelLock.Leave();
 		}
 	}
 
+	vDecoder.Reset();
+
 	return fSuccess;
 }
 
 void CWaveSession::InitiateReconnect()
 {
-	m_lpReconnectTimer->SetInterval(TIMER_RECONNECT_INTERVAL_INITIAL);
-	m_lpReconnectTimer->SetRunning(TRUE);
+	// Reconnecting starts with the cheapest tier we still have the
+	// credentials for. The channel is first reopened with the SID and AID
+	// we already have. When the server no longer knows the SID, a new one
+	// is requested with the cookies we already have. Only when that fails
+	// too, we log in again.
 
-	m_nState = WSS_RECONNECTING;
+	m_vChannelLock.Enter();
 
-	SignalProgress(WCS_RECONNECTING);
-}
+	BOOL fHaveSID = !m_szSID.empty();
 
-wstring CWaveSession::BuildHash()
-{
-	return CreateHash(12, WAVE_HASH_POOL);
+	m_vChannelLock.Leave();
+
+	if (fHaveSID)
+	{
+		m_nReconnectTier = WRT_CHANNEL;
+	}
+	else if (m_lpCookies != NULL)
+	{
+		m_nReconnectTier = WRT_SID;
+	}
+	else
+	{
+		m_nReconnectTier = WRT_LOGIN;
+	}
+
+	m_nReconnectAttempts = 0;
+	m_dwReconnectStarted = GetTickCount();
+
+	ScheduleReconnect();
 }
 
-CWaveResponse * CWaveSession::ParseWfeResponse(wstring szResponse, BOOL & fSuccess)
+void CWaveSession::ReconnectCompleted()
 {
-	Json::Reader vReader;
-	Json::Value vRoot;
-
-	if (!vReader.parse(szResponse, vRoot))
+	if (m_dwReconnectStarted != 0)
 	{
-		fSuccess = FALSE;
-		return NULL;
-	}
+		m_nLastReconnectTier = m_nReconnectTier;
+		m_dwLastReconnectTime = GetTickCount() - m_dwReconnectStarted;
 
-	fSuccess = TRUE;
+		m_dwReconnectStarted = 0;
+	}
+}
 
-	return CWaveResponse::Parse(vRoot);
+wstring CWaveSession::BuildHash()
+{
+	return CreateHash(12, WAVE_HASH_POOL);
 }
 
+
 void CWaveSession::PostRequests()
 {
 	// This method is responsible for deleting the requests because requests
@@ -988,42 +1238,81 @@ void CWaveSession::PostRequests()
 	// becomes necessary, this function will take the requests for later retrieval.
 	// Now, we just delete them.
 
-	wstringstream szPostData;
+	wstringstream szRequests;
 
 	ASSERT(m_vRequestQueue.size() > 0);
 
-	szPostData << L"count=" << m_vRequestQueue.size();
+	// Requests are added until the post would become too large. The first
+	// request is always added, so a large request is still posted.
 
 	INT nOffset = 0;
+	size_t nPostSize = 0;
 
-	for (TWaveRequestVectorConstIter iter = m_vRequestQueue.begin(); iter != m_vRequestQueue.end(); iter++)
+	TWaveRequestVectorIter iter = m_vRequestQueue.begin();
+
+	TStringVector vStartedListeners;
+
+	for (; iter != m_vRequestQueue.end(); iter++)
 	{
-		szPostData << L"&req" << nOffset << L"_key=" << UrlEncode(SerializeRequest(*iter));
+		// A request that depends on a post in flight waits until that
+		// post has completed, and so do the requests after it.
+
+		if (IsRequestBlocked(*iter))
+		{
+			ASSERT(nOffset > 0);
+
+			break;
+		}
+
+		INT nNextRequestID = m_nNextRequestID;
+
+		wstring szRequest = Format(L"&req%d_key=", nOffset) + UrlEncode(SerializeRequest(*iter));
+
+		if (nOffset > 0 && nPostSize + szRequest.size() > WAVE_POST_MAX_SIZE)
+		{
+			// The request ID is handed out again with the next post.
+
+			m_nNextRequestID = nNextRequestID;
+
+			break;
+		}
+
+		szRequests << szRequest;
+		nPostSize += szRequest.size();
+
+		if ((*iter)->GetType() == WMT_START_LISTENING)
+		{
+			vStartedListeners.push_back(((CWaveRequestStartListening *)*iter)->GetListenerID());
+		}
 
 		nOffset++;
 	}
 
-	// Post the JSON to the channel.
+	wstringstream szPostData;
+
+	szPostData << L"count=" << nOffset << szRequests.str();
 
-	wstring szUrl = Format(WAVE_URL_CHANNEL_POST, m_szSID.c_str(), m_nRID++, BuildHash().c_str());
+	// Post the JSON to the channel. Every post gets the next RID, also
+	// when earlier posts are still in flight.
 
-	if (m_lpPostRequest != NULL)
-	{
-		m_vOwnedRequests.push_back(m_lpPostRequest);
-	}
+	WAVE_POST vPost;
 
-	m_lpPostRequest = new CCurl(szUrl, m_lpTargetWindow);
+	m_vChannelLock.Enter();
 
-	m_lpPostRequest->SetUserAgent(USERAGENT);
-	m_lpPostRequest->SetTimeout(WEB_TIMEOUT_SHORT);
-	m_lpPostRequest->SetIgnoreSSLErrors(TRUE);
-	m_lpPostRequest->SetCookies(GetCookies());
+	vPost.szSID = m_szSID;
 
-	m_lpPostRequest->SetUrlEncodedPostData(szPostData.str());
+	m_vChannelLock.Leave();
 
-	CNotifierApp::Instance()->QueueRequest(m_lpPostRequest);
+	vPost.nRID = m_nRID++;
+	vPost.szPostData = szPostData.str();
+	vPost.nRetries = 0;
+	vPost.vStartedListeners.swap(vStartedListeners);
 
-	for (TWaveRequestVectorIter iter1 = m_vRequestQueue.begin(); iter1 != m_vRequestQueue.end(); iter1++)
+	SendPost(vPost);
+
+	m_vPosts.push_back(vPost);
+
+	for (TWaveRequestVectorIter iter1 = m_vRequestQueue.begin(); iter1 != iter; iter1++)
 	{
 		ASSERT(*iter1 != NULL);
 
@@ -1032,7 +1321,97 @@ void CWaveSession::PostRequests()
 		delete *iter1;
 	}
 
-	m_vRequestQueue.clear();
+	m_vRequestQueue.erase(m_vRequestQueue.begin(), iter);
+}
+
+void CWaveSession::CoalesceRequests()
+{
+	// Every request is compared with the requests before it in the queue.
+	// It is dropped when an earlier request can take it over, and both
+	// are dropped when it undoes the earlier request.
+
+	UINT uIndex = 0;
+
+	while (uIndex < m_vRequestQueue.size())
+	{
+		CWaveRequest * lpRequest = m_vRequestQueue[uIndex];
+		BOOL fRemoved = FALSE;
+
+		for (UINT uEarlier = 0; uEarlier < uIndex; uEarlier++)
+		{
+			CWaveRequest * lpEarlier = m_vRequestQueue[uEarlier];
+
+			if (lpRequest->Cancels(lpEarlier))
+			{
+				m_vRequestQueue.erase(m_vRequestQueue.begin() + uIndex);
+				m_vRequestQueue.erase(m_vRequestQueue.begin() + uEarlier);
+
+				delete lpRequest;
+				delete lpEarlier;
+
+				// The next request has moved into the place of the
+				// request before this one.
+
+				uIndex--;
+				fRemoved = TRUE;
+
+				break;
+			}
+
+			if (lpEarlier->Merge(lpRequest))
+			{
+				m_vRequestQueue.erase(m_vRequestQueue.begin() + uIndex);
+
+				delete lpRequest;
+
+				fRemoved = TRUE;
+
+				break;
+			}
+		}
+
+		if (!fRemoved)
+		{
+			uIndex++;
+		}
+	}
+}
+
+void CWaveSession::SendPost(WAVE_POST & vPost)
+{
+	wstring szUrl = Format(WAVE_URL_CHANNEL_POST, vPost.szSID.c_str(), vPost.nRID, BuildHash().c_str());
+
+	vPost.lpRequest = new CCurl(szUrl, m_lpTargetWindow);
+
+	vPost.lpRequest->SetUserAgent(USERAGENT);
+	vPost.lpRequest->SetTimeout(WEB_TIMEOUT_SHORT);
+	vPost.lpRequest->SetIgnoreSSLErrors(TRUE);
+	vPost.lpRequest->SetCookies(GetCookies());
+
+	vPost.lpRequest->SetUrlEncodedPostData(vPost.szPostData);
+
+	CNotifierApp::Instance()->QueueRequest(vPost.lpRequest);
+}
+
+BOOL CWaveSession::IsRequestBlocked(CWaveRequest * lpRequest) const
+{
+	ASSERT(lpRequest != NULL);
+
+	// Posts in flight may overtake each other. Only a request that stops
+	// a listener of which the start is still in flight has to wait.
+
+	for (TWavePostVectorConstIter iter = m_vPosts.begin(); iter != m_vPosts.end(); iter++)
+	{
+		for (TStringVectorConstIter iter1 = iter->vStartedListeners.begin(); iter1 != iter->vStartedListeners.end(); iter1++)
+		{
+			if (lpRequest->DependsOnListener(*iter1))
+			{
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
 }
 
 wstring CWaveSession::SerializeRequest(CWaveRequest * lpRequest)
@@ -1059,6 +1438,160 @@ wstring CWaveSession::SerializeRequest(CWaveRequest * lpRequest)
 	return vWriter.write(vRoot);
 }
 
+BOOL CWaveSession::SaveSessionState()
+{
+	// The session is only kept for users that let us keep their password;
+	// the state is encrypted the same way the password is.
+
+	CSettings vSettings(TRUE);
+
+	BOOL fRememberPassword;
+
+	if (
+		!vSettings.GetRememberPassword(fRememberPassword) ||
+		!fRememberPassword ||
+		m_lpCookies == NULL
+	) {
+		return FALSE;
+	}
+
+	Json::Value vRoot(Json::objectValue);
+
+	vRoot[L"username"] = Json::Value(m_szUsername);
+	vRoot[L"host"] = Json::Value(WAVE_URL_WAVE_HOST);
+	vRoot[L"authKey"] = Json::Value(m_szAuthKey);
+	vRoot[L"email"] = Json::Value(m_szEmailAddress);
+	vRoot[L"sessionId"] = Json::Value(m_szSessionID);
+	vRoot[L"profileId"] = Json::Value(m_szProfileID);
+	vRoot[L"cookies"] = Json::Value(Json::arrayValue);
+
+	UINT uOffset = 0;
+
+	for (curl_slist * lpCookie = m_lpCookies->GetCookies(); lpCookie != NULL; lpCookie = lpCookie->next)
+	{
+		vRoot[L"cookies"][uOffset] = Json::Value(ConvertToWideChar(lpCookie->data));
+
+		uOffset++;
+	}
+
+	Json::FastWriter vWriter;
+
+	if (!vSettings.SetSessionState(vWriter.write(vRoot)))
+	{
+		LOG("Could not save the session state");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL CWaveSession::RestoreSessionState()
+{
+	CSettings vSettings(FALSE);
+
+	// The user may have stopped letting us keep their password after the
+	// session was saved.
+
+	BOOL fRememberPassword;
+
+	if (!vSettings.GetRememberPassword(fRememberPassword) || !fRememberPassword)
+	{
+		DeleteSessionState();
+
+		return FALSE;
+	}
+
+	wstring szState;
+
+	if (!vSettings.GetSessionState(szState) || szState.empty())
+	{
+		return FALSE;
+	}
+
+	Json::Value vRoot;
+	Json::Reader vReader;
+
+	if (!vReader.parse(szState, vRoot) || !vRoot.isObject())
+	{
+		LOG("Could not parse the session state");
+
+		DeleteSessionState();
+
+		return FALSE;
+	}
+
+	// A session of another user, or one kept against another server, is
+	// never continued.
+
+	if (
+		!vRoot[L"username"].isString() ||
+		vRoot[L"username"].asString() != m_szUsername ||
+		!vRoot[L"host"].isString() ||
+		vRoot[L"host"].asString() != WAVE_URL_WAVE_HOST ||
+		!vRoot[L"authKey"].isString() ||
+		!vRoot[L"email"].isString() ||
+		!vRoot[L"sessionId"].isString() ||
+		!vRoot[L"profileId"].isString() ||
+		!vRoot[L"cookies"].isArray() ||
+		vRoot[L"cookies"].size() == 0
+	) {
+		return FALSE;
+	}
+
+	// The state is read back from the registry, so a state that was
+	// damaged or written by an older version is thrown away as a whole.
+
+	Json::Value & vCookies = vRoot[L"cookies"];
+
+	for (Json::Value::UInt i = 0; i < vCookies.size(); i++)
+	{
+		if (!vCookies[i].isString())
+		{
+			LOG("Could not parse the session state");
+
+			DeleteSessionState();
+
+			return FALSE;
+		}
+	}
+
+	wstring szAuthKey(vRoot[L"authKey"].asString());
+	wstring szEmailAddress(vRoot[L"email"].asString());
+	wstring szSessionID(vRoot[L"sessionId"].asString());
+	wstring szProfileID(vRoot[L"profileId"].asString());
+
+	if (
+		szAuthKey.empty() ||
+		szEmailAddress.empty() ||
+		szSessionID.empty() ||
+		szProfileID.empty()
+	) {
+		return FALSE;
+	}
+
+	curl_slist * lpCookies = NULL;
+
+	for (Json::Value::UInt j = 0; j < vCookies.size(); j++)
+	{
+		lpCookies = curl_slist_append(lpCookies, ConvertToMultiByte(vCookies[j].asString()).c_str());
+	}
+
+	m_szAuthKey = szAuthKey;
+	m_szEmailAddress = szEmailAddress;
+	m_szSessionID = szSessionID;
+	m_szProfileID = szProfileID;
+
+	SetCookies(new CCurlCookies(lpCookies));
+
+	return TRUE;
+}
+
+void CWaveSession::DeleteSessionState()
+{
+	CSettings(TRUE).DeleteSessionState();
+}
+
 void CWaveSession::AddListener(CWaveListener * lpListener)
 {
 	ASSERT(lpListener != NULL);
@@ -1098,18 +1631,101 @@ void CWaveSession::ReconnectTimer()
 {
 	m_lpReconnectTimer->SetRunning(FALSE);
 
-	Reconnect();
+	switch (m_nReconnectTier)
+	{
+	case WRT_CHANNEL:
+		if (m_nState == WSS_ONLINE)
+		{
+			PostChannelRequest();
+		}
+		break;
+
+	case WRT_SID:
+		ResetChannelParameters();
+		PostSIDRequest();
+		break;
+
+	default:
+		Reconnect();
+		break;
+	}
 }
 
 void CWaveSession::NextReconnect()
 {
-	INT nNextInterval = m_lpReconnectTimer->GetInterval() * 2;
+	m_nReconnectAttempts++;
 
-	m_lpReconnectTimer->SetInterval(
-		nNextInterval > TIMER_RECONNECT_INTERVAL_MAX ? TIMER_RECONNECT_INTERVAL_MAX : nNextInterval
-	);
+	m_vChannelLock.Enter();
+
+	BOOL fHaveSID = !m_szSID.empty();
+
+	m_vChannelLock.Leave();
+
+	if (m_nReconnectTier == WRT_CHANNEL && (m_nReconnectAttempts >= RECONNECT_CHANNEL_ATTEMPTS || !fHaveSID))
+	{
+		m_nReconnectTier = m_lpCookies != NULL ? WRT_SID : WRT_LOGIN;
+		m_nReconnectAttempts = 0;
+	}
+	else if (m_nReconnectTier == WRT_SID && m_nReconnectAttempts >= RECONNECT_SID_ATTEMPTS)
+	{
+		m_nReconnectTier = WRT_LOGIN;
+		m_nReconnectAttempts = 0;
+	}
+
+	ScheduleReconnect();
+}
+
+void CWaveSession::ScheduleReconnect()
+{
+	INT nInterval;
+	INT nMaxInterval;
+
+	switch (m_nReconnectTier)
+	{
+	case WRT_CHANNEL:
+		nInterval = TIMER_RECONNECT_CHANNEL_INITIAL;
+		nMaxInterval = TIMER_RECONNECT_CHANNEL_MAX;
+		break;
+
+	case WRT_SID:
+		nInterval = TIMER_RECONNECT_SID_INITIAL;
+		nMaxInterval = TIMER_RECONNECT_SID_MAX;
+		break;
+
+	default:
+		nInterval = TIMER_RECONNECT_INTERVAL_INITIAL;
+		nMaxInterval = TIMER_RECONNECT_INTERVAL_MAX;
+		break;
+	}
+
+	for (INT i = 0; i < m_nReconnectAttempts && nInterval < nMaxInterval; i++)
+	{
+		nInterval *= 2;
+	}
+
+	if (nInterval > nMaxInterval)
+	{
+		nInterval = nMaxInterval;
+	}
 
+	// Half of the interval is random, so clients that lost their
+	// connection at the same time do not all come back at the same time.
+
+	nInterval = nInterval / 2 + Rand(0, nInterval / 2);
+
+	m_lpReconnectTimer->SetInterval(nInterval);
 	m_lpReconnectTimer->SetRunning(TRUE);
+
+	// The channel is reopened without telling anyone; the session stays
+	// online and the view stays valid, because the server still has the
+	// listeners of the SID. The other tiers start a new channel.
+
+	if (m_nReconnectTier != WRT_CHANNEL && m_nState != WSS_RECONNECTING)
+	{
+		m_nState = WSS_RECONNECTING;
+
+		SignalProgress(WCS_RECONNECTING);
+	}
 }
 
 void CWaveSession::StopReconnecting()
@@ -1138,17 +1754,32 @@ void CWaveSession::StopReconnecting()
 void CWaveSession::QueueRequest(CWaveRequest * lpRequest)
 {
 	m_vRequestQueue.push_back(lpRequest);
+
+	if (m_vRequestQueue.size() > m_uMaxQueuedRequests)
+	{
+		m_uMaxQueuedRequests = m_vRequestQueue.size();
+	}
 }
 
 void CWaveSession::FlushRequestQueue()
 {
-	if (
-		m_nFlushSuspended == 0 &&
-		!m_szSID.empty() &&
-		m_lpPostRequest == NULL &&
-		m_vRequestQueue.size() > 0
-	) {
-		PostRequests();
+	m_vChannelLock.Enter();
+
+	BOOL fHaveSID = !m_szSID.empty();
+
+	m_vChannelLock.Leave();
+
+	if (m_nFlushSuspended == 0 && fHaveSID)
+	{
+		CoalesceRequests();
+
+		while (
+			m_vPosts.size() < WAVE_POST_WINDOW &&
+			m_vRequestQueue.size() > 0 &&
+			!IsRequestBlocked(m_vRequestQueue[0])
+		) {
+			PostRequests();
+		}
 	}
 }
 
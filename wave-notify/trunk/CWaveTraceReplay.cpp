@@ -0,0 +1,190 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+#include "include.h"
+#include "wave.h"
+
+CWaveTraceReplay::CWaveTraceReplay(CWaveSession * lpSession, wstring szPath, BOOL fRealTime) : CThread(TRUE)
+{
+	ASSERT(lpSession != NULL && !szPath.empty());
+
+	m_lpSession = lpSession;
+	m_szPath = szPath;
+	m_fRealTime = fRealTime;
+	m_fSuccess = FALSE;
+	m_dwElapsed = 0;
+	m_dwChunks = 0;
+	m_dwBytes = 0;
+
+	// The replay has its own reader and decoder, but its responses are
+	// reported to the target window of the session. Mixing them with
+	// the responses of a live channel would corrupt the view, so the
+	// replay only runs while the session is offline.
+
+	m_fOffline = lpSession->GetState() == WSS_OFFLINE;
+
+	if (!m_fOffline)
+	{
+		LOG("Not replaying the channel trace while the session is not offline");
+	}
+
+	CWaveSession::InitialiseChannelReader(m_vReader);
+
+	m_lpDecoder = new CWaveDecoder();
+
+	Resume();
+}
+
+CWaveTraceReplay::~CWaveTraceReplay()
+{
+	Join();
+
+	delete m_lpDecoder;
+}
+
+BOOL CWaveTraceReplay::Wait()
+{
+	Join();
+
+	return m_fSuccess;
+}
+
+DWORD CWaveTraceReplay::ThreadProc()
+{
+	// The chunks are fed through the same reader the channel uses, so
+	// the responses reach the target window of the session as if they
+	// came from the server.
+
+	if (!m_fOffline)
+	{
+		return 0;
+	}
+
+	HANDLE hFile = CreateFile(
+		m_szPath.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		LOG("Could not open the channel trace");
+		return 0;
+	}
+
+	DWORD dwStarted = GetTickCount();
+	DWORD dwFirstChunk = 0;
+	BOOL fFirstChunk = TRUE;
+	CWaveReader * lpReader = NULL;
+	BOOL fReadFailed = FALSE;
+	string szData;
+	WAVE_TRACE_CHUNK vChunk;
+
+	m_fSuccess = TRUE;
+
+	while (ReadTrace(hFile, &vChunk, sizeof(WAVE_TRACE_CHUNK)))
+	{
+		if (fFirstChunk)
+		{
+			dwFirstChunk = vChunk.dwTime;
+			fFirstChunk = FALSE;
+		}
+
+		if (vChunk.cbData == 0 || lpReader == NULL)
+		{
+			if (lpReader != NULL)
+			{
+				delete lpReader;
+			}
+
+			lpReader = new CWaveReader(m_lpSession, this);
+
+			fReadFailed = FALSE;
+
+			if (vChunk.cbData == 0)
+			{
+				continue;
+			}
+		}
+
+		szData.resize(vChunk.cbData);
+
+		if (!ReadTrace(hFile, &szData[0], vChunk.cbData))
+		{
+			LOG("Channel trace is truncated");
+
+			m_fSuccess = FALSE;
+			break;
+		}
+
+		// In real time, the chunks are fed at the intervals they were
+		// recorded with. Otherwise they are fed as fast as the reader
+		// takes them.
+
+		if (m_fRealTime)
+		{
+			DWORD dwDue = vChunk.dwTime - dwFirstChunk;
+			DWORD dwNow = GetTickCount() - dwStarted;
+
+			if (dwDue > dwNow)
+			{
+				Sleep(dwDue - dwNow);
+			}
+		}
+
+		// Like on the reader thread, the rest of the data of a channel
+		// request is dropped after the reader has failed.
+
+		if (!fReadFailed && !lpReader->Read((LPBYTE)&szData[0], vChunk.cbData))
+		{
+			fReadFailed = TRUE;
+			m_fSuccess = FALSE;
+		}
+
+		m_dwChunks++;
+		m_dwBytes += vChunk.cbData;
+	}
+
+	m_dwElapsed = GetTickCount() - dwStarted;
+
+	if (lpReader != NULL)
+	{
+		delete lpReader;
+	}
+
+	CloseHandle(hFile);
+
+	return 0;
+}
+
+BOOL CWaveTraceReplay::ParseChannelResponse(LPCSTR szBegin, LPCSTR szEnd)
+{
+	return m_lpSession->ReplayChannelResponse(m_vReader, *m_lpDecoder, szBegin, szEnd);
+}
+
+BOOL CWaveTraceReplay::ReadTrace(HANDLE hFile, LPVOID lpBuffer, DWORD cbBuffer)
+{
+	ASSERT(hFile != INVALID_HANDLE_VALUE && lpBuffer != NULL);
+
+	DWORD dwRead;
+
+	return ReadFile(hFile, lpBuffer, cbBuffer, &dwRead, NULL) && dwRead == cbBuffer;
+}
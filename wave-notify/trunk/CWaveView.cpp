@@ -18,11 +18,17 @@
 #include "stdafx.h"
 #include "include.h"
 #include "wave.h"
+#include "notifierapp.h"
+
+UINT CWaveView::m_uMostTextHeld = 0;
+UINT CWaveView::m_uWavesOverBudget = 0;
 
 CWaveView::CWaveView()
 {
 	m_lpContacts = new CWaveContactCollection();
 	m_lpWaves = new CWaveCollection();
+	m_fAllChanged = TRUE;
+	m_uUnreadWaves = 0;
 }
 
 CWaveView::~CWaveView()
@@ -68,13 +74,114 @@ void CWaveView::ProcessWaves(CWaveResponseStartListening * lpResponse)
 {
 	ASSERT(lpResponse != NULL);
 
+	// The unread count and the changed waves are kept up to date while
+	// merging, so the application only has to look at the waves this
+	// response touched.
+
+	const TWaveMap & vCurrent = m_lpWaves->GetWaves();
+	const TWaveMap & vWaves = lpResponse->GetWaves()->GetWaves();
+
+	for (TWaveMapConstIter iter = vWaves.begin(); iter != vWaves.end(); iter++)
+	{
+		TWaveMapConstIter pos = vCurrent.find(iter->first);
+
+		// The decoder sends the wave the view already has when the wave
+		// did not change.
+
+		if (pos != vCurrent.end() && pos->second == iter->second)
+		{
+			continue;
+		}
+
+		if (pos != vCurrent.end() && pos->second->GetUnreadMessages() > 0)
+		{
+			m_uUnreadWaves--;
+		}
+
+		if (iter->second->GetUnreadMessages() > 0)
+		{
+			m_uUnreadWaves++;
+		}
+
+		m_vChanges[iter->first] = TRUE;
+	}
+
 	m_lpWaves->Merge(lpResponse->GetWaves());
 
-	TStringVector vRemovedWaves;
+	const TStringVector & vRemovedWaves = lpResponse->GetRemovedWaves();
+	TStringBoolMap vRemoved;
 
-	lpResponse->GetRemovedWaves(vRemovedWaves);
+	for (TStringVectorConstIter iter1 = vRemovedWaves.begin(); iter1 != vRemovedWaves.end(); iter1++)
+	{
+		TWaveMapConstIter pos = vCurrent.find(*iter1);
+
+		if (
+			pos != vCurrent.end() &&
+			pos->second->GetUnreadMessages() > 0 &&
+			vRemoved.find(*iter1) == vRemoved.end()
+		) {
+			m_uUnreadWaves--;
+		}
+
+		vRemoved[*iter1] = TRUE;
+		m_vChanges[*iter1] = TRUE;
+	}
 
 	m_lpWaves->RemoveWaves(vRemovedWaves);
+
+	EnforceTextBudget();
+}
+
+void CWaveView::EnforceTextBudget()
+{
+	// The number of waves with unread messages is not bounded, so the
+	// text their messages keep is held under a budget. When the view
+	// goes over it, the text of the oldest waves is discarded first.
+	// Waves that have changed since the last report are left alone;
+	// their text may still be shown in a popup.
+
+	UINT uBudget = CNotifierApp::Instance()->GetMessageTextBudget();
+	const TWaveMap & vWaves = m_lpWaves->GetWaves();
+
+	UINT uTextLength = 0;
+	TWaveVector vCandidates;
+
+	for (TWaveMapConstIter iter = vWaves.begin(); iter != vWaves.end(); iter++)
+	{
+		if (iter->second->GetTextLength() == 0)
+		{
+			continue;
+		}
+
+		uTextLength += iter->second->GetTextLength();
+
+		if (!m_fAllChanged && m_vChanges.find(iter->first) == m_vChanges.end())
+		{
+			vCandidates.push_back(iter->second);
+		}
+	}
+
+	if (uTextLength > uBudget)
+	{
+		sort(vCandidates.begin(), vCandidates.end(), CompareWaveTimes);
+
+		for (
+			TWaveVectorIter iter1 = vCandidates.begin();
+			iter1 != vCandidates.end() && uTextLength > uBudget;
+			iter1++
+		) {
+			uTextLength -= (*iter1)->GetTextLength();
+
+			(*iter1)->DiscardText();
+
+			m_uWavesOverBudget++;
+		}
+	}
+
+	if (uTextLength > m_uMostTextHeld)
+	{
+		m_uMostTextHeld = uTextLength;
+	}
 }
 
 void CWaveView::ProcessContactUpdates(CWaveContactStatusCollection * lpStatuses)
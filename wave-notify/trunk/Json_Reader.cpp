@@ -31,27 +31,176 @@ containsNewLine( Reader::Location begin,
                  Reader::Location end )
 {
    for ( ;begin < end; ++begin )
-      if ( *begin == L'\n'  ||  *begin == L'\r' )
+      if ( *begin == '\n'  ||  *begin == '\r' )
          return true;
    return false;
 }
 
 
+static const unsigned char utf8TrailingBytes[256] = {
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+   1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+   2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3,4,4,4,4,5,5,5,5
+};
+
+static const unsigned int utf8LeadMask[6] = {
+   0x7F, 0x1F, 0x0F, 0x07, 0x03, 0x01
+};
+
+/// Decodes a single UTF-8 sequence starting at \c current and appends it to
+/// \c decoded as UTF-16. Malformed and truncated sequences are replaced by
+/// U+FFFD.
+static void 
+appendUtf8Sequence( Reader::Location &current, 
+                    Reader::Location end, 
+                    std::wstring &decoded )
+{
+   unsigned char lead = (unsigned char)*current++;
+   int trailing = utf8TrailingBytes[lead];
+   if ( trailing == 0 )
+   {
+      decoded += lead < 0x80 ? wchar_t(lead) : wchar_t(0xFFFD);
+      return;
+   }
+   if ( end - current < trailing )
+   {
+      current = end;
+      decoded += wchar_t(0xFFFD);
+      return;
+   }
+   unsigned int ch = lead & utf8LeadMask[trailing];
+   for ( int index = 0; index < trailing; ++index )
+      ch = ( ch << 6 ) | ( (unsigned char)*current++ & 0x3F );
+   if ( ch < 0x10000 )
+   {
+      if ( ch >= 0xD800  &&  ch <= 0xDFFF )
+         ch = 0xFFFD;
+      decoded += wchar_t(ch);
+   }
+   else if ( ch <= 0x10FFFF )
+   {
+      ch -= 0x10000;
+      decoded += wchar_t( 0xD800 + ( ch >> 10 ) );
+      decoded += wchar_t( 0xDC00 + ( ch & 0x3FF ) );
+   }
+   else
+   {
+      decoded += wchar_t(0xFFFD);
+   }
+}
+
+
+static std::wstring 
+decodeUtf8( Reader::Location begin, 
+            Reader::Location end )
+{
+   std::wstring decoded;
+   decoded.reserve( end - begin );
+   while ( begin < end )
+      appendUtf8Sequence( begin, end, decoded );
+   return decoded;
+}
+
+
+static void 
+appendUtf8( unsigned int ch, 
+            std::string &encoded )
+{
+   if ( ch < 0x80 )
+   {
+      encoded += char(ch);
+   }
+   else if ( ch < 0x800 )
+   {
+      encoded += char( 0xC0 | ( ch >> 6 ) );
+      encoded += char( 0x80 | ( ch & 0x3F ) );
+   }
+   else if ( ch < 0x10000 )
+   {
+      encoded += char( 0xE0 | ( ch >> 12 ) );
+      encoded += char( 0x80 | ( ( ch >> 6 ) & 0x3F ) );
+      encoded += char( 0x80 | ( ch & 0x3F ) );
+   }
+   else
+   {
+      encoded += char( 0xF0 | ( ch >> 18 ) );
+      encoded += char( 0x80 | ( ( ch >> 12 ) & 0x3F ) );
+      encoded += char( 0x80 | ( ( ch >> 6 ) & 0x3F ) );
+      encoded += char( 0x80 | ( ch & 0x3F ) );
+   }
+}
+
+
+static void 
+encodeUtf8( const std::wstring &source, 
+            std::string &encoded )
+{
+   encoded.resize( 0 );
+   encoded.reserve( source.length() );
+   std::wstring::const_iterator it = source.begin();
+   while ( it != source.end() )
+   {
+      unsigned int ch = *it++;
+      if ( ch >= 0xD800  &&  ch <= 0xDBFF  &&  
+           it != source.end()  &&  *it >= 0xDC00  &&  *it <= 0xDFFF )
+      {
+         ch = 0x10000 + ( ( ch - 0xD800 ) << 10 ) + ( *it++ - 0xDC00 );
+      }
+      appendUtf8( ch, encoded );
+   }
+}
+
+
 // Class Reader
 // //////////////////////////////////////////////////////////////////
 
+ReaderHandler::~ReaderHandler()
+{
+}
+
+
 Reader::Reader()
+   : embeddedTagDepth_( 0 )
+   , embeddedDepth_( 0 )
+   , arrayDepth_( 0 )
+   , handler_( 0 )
+   , lastValueIsTag_( false )
+{
+}
+
+
+void 
+Reader::setEmbeddedDocumentTag( const std::wstring &tag, int depth )
 {
+   embeddedTag_ = tag;
+   embeddedTagDepth_ = depth;
 }
 
 bool
 Reader::parse( const std::wstring &document, 
                Value &root,
                bool collectComments )
+{
+   encodeUtf8( document, document_ );
+   const char *begin = document_.c_str();
+   const char *end = begin + document_.length();
+   return parse( begin, end, root, collectComments );
+}
+
+
+bool
+Reader::parse( const std::string &document, 
+               Value &root,
+               bool collectComments )
 {
    document_ = document;
-   const wchar_t *begin = document_.c_str();
-   const wchar_t *end = begin + document_.length();
+   const char *begin = document_.c_str();
+   const char *end = begin + document_.length();
    return parse( begin, end, root, collectComments );
 }
 /*
@@ -73,7 +222,7 @@ Reader::parse( std::istream& sin,
 }
 */
 bool 
-Reader::parse( const wchar_t *beginDoc, const wchar_t *endDoc, 
+Reader::parse( const char *beginDoc, const char *endDoc, 
                Value &root,
                bool collectComments )
 {
@@ -84,6 +233,9 @@ Reader::parse( const wchar_t *beginDoc, const wchar_t *endDoc,
    lastValueEnd_ = 0;
    lastValue_ = 0;
    commentsBefore_ = L"";
+   embeddedDepth_ = 0;
+   arrayDepth_ = 0;
+   handler_ = 0;
    errors_.clear();
    while ( !nodes_.empty() )
       nodes_.pop();
@@ -98,6 +250,41 @@ Reader::parse( const wchar_t *beginDoc, const wchar_t *endDoc,
 }
 
 
+bool 
+Reader::parse( const char *beginDoc, const char *endDoc, 
+               ValueArena &arena,
+               bool collectComments )
+{
+   arena.clear();
+   ValueArena::Scope scope( &arena );
+   return parse( beginDoc, endDoc, arena.root(), collectComments );
+}
+
+
+bool 
+Reader::parse( const char *beginDoc, const char *endDoc, 
+               ReaderHandler &handler )
+{
+   begin_ = beginDoc;
+   end_ = endDoc;
+   collectComments_ = false;
+   current_ = begin_;
+   lastValueEnd_ = 0;
+   lastValue_ = 0;
+   commentsBefore_ = L"";
+   embeddedDepth_ = 0;
+   arrayDepth_ = 0;
+   handler_ = &handler;
+   errors_.clear();
+   while ( !nodes_.empty() )
+      nodes_.pop();
+
+   bool successful = readValue();
+   handler_ = 0;
+   return successful;
+}
+
+
 bool
 Reader::readValue()
 {
@@ -112,6 +299,8 @@ Reader::readValue()
    }
 
 
+   bool isTag = false;
+
    switch ( token.type_ )
    {
    case tokenObjectBegin:
@@ -124,21 +313,32 @@ Reader::readValue()
       successful = decodeNumber( token );
       break;
    case tokenString:
-      successful = decodeString( token );
+      successful = decodeString( token, isTag );
       break;
    case tokenTrue:
-      currentValue() = true;
+      if ( handler_ )
+         successful = checkHandler( handler_->boolValue( true ), token );
+      else
+         currentValue() = true;
       break;
    case tokenFalse:
-      currentValue() = false;
+      if ( handler_ )
+         successful = checkHandler( handler_->boolValue( false ), token );
+      else
+         currentValue() = false;
       break;
    case tokenNull:
-      currentValue() = Value();
+      if ( handler_ )
+         successful = checkHandler( handler_->nullValue(), token );
+      else
+         currentValue() = Value();
       break;
    default:
       return addError( L"Syntax error: value, object or array expected.", token );
    }
 
+   lastValueIsTag_ = isTag;
+
    if ( collectComments_ )
    {
       lastValueEnd_ = current_;
@@ -179,60 +379,60 @@ Reader::readToken( Token &token )
    bool ok = true;
    switch ( c )
    {
-   case L'{':
+   case '{':
       token.type_ = tokenObjectBegin;
       break;
-   case L'}':
+   case '}':
       token.type_ = tokenObjectEnd;
       break;
-   case L'[':
+   case '[':
       token.type_ = tokenArrayBegin;
       break;
-   case L']':
+   case ']':
       token.type_ = tokenArrayEnd;
       break;
-   case L'"':
+   case '"':
       token.type_ = tokenString;
       ok = readString();
       break;
-   case L'/':
+   case '/':
       token.type_ = tokenComment;
       ok = readComment();
       break;
-   case L'0':
-   case L'1':
-   case L'2':
-   case L'3':
-   case L'4':
-   case L'5':
-   case L'6':
-   case L'7':
-   case L'8':
-   case L'9':
-   case L'-':
+   case '0':
+   case '1':
+   case '2':
+   case '3':
+   case '4':
+   case '5':
+   case '6':
+   case '7':
+   case '8':
+   case '9':
+   case '-':
       token.type_ = tokenNumber;
       readNumber();
       break;
-   case L't':
+   case 't':
       token.type_ = tokenTrue;
-      ok = match( L"rue", 3 );
+      ok = match( "rue", 3 );
       break;
-   case L'f':
+   case 'f':
       token.type_ = tokenFalse;
-      ok = match( L"alse", 4 );
+      ok = match( "alse", 4 );
       break;
-   case L'n':
+   case 'n':
       token.type_ = tokenNull;
-      ok = match( L"ull", 3 );
+      ok = match( "ull", 3 );
       break;
-   case L',':
+   case ',':
       token.type_ = tokenArraySeparator;
       break;
-   case L':':
+   case ':':
       token.type_ = tokenMemberSeparator;
       break;
    case 0:
-   case L';':
+   case ';':
       token.type_ = tokenEndOfStream;
       break;
    default:
@@ -252,7 +452,7 @@ Reader::skipSpaces()
    while ( current_ != end_ )
    {
       Char c = *current_;
-      if ( c == L' '  ||  c == L'\t'  ||  c == L'\r'  ||  c == L'\n' )
+      if ( c == ' '  ||  c == '\t'  ||  c == '\r'  ||  c == '\n' )
          ++current_;
       else
          break;
@@ -281,9 +481,9 @@ Reader::readComment()
    Location commentBegin = current_ - 1;
    Char c = getNextChar();
    bool successful = false;
-   if ( c == L'*' )
+   if ( c == '*' )
       successful = readCStyleComment();
-   else if ( c == L'/' )
+   else if ( c == '/' )
       successful = readCppStyleComment();
    if ( !successful )
       return false;
@@ -293,7 +493,7 @@ Reader::readComment()
       CommentPlacement placement = commentBefore;
       if ( lastValueEnd_  &&  !containsNewLine( lastValueEnd_, commentBegin ) )
       {
-         if ( c != L'*'  ||  !containsNewLine( commentBegin, current_ ) )
+         if ( c != '*'  ||  !containsNewLine( commentBegin, current_ ) )
             placement = commentAfterOnSameLine;
       }
 
@@ -312,13 +512,13 @@ Reader::addComment( Location begin,
    if ( placement == commentAfterOnSameLine )
    {
       CHECK( lastValue_ != 0 );
-      lastValue_->setComment( std::wstring( begin, end ), placement );
+      lastValue_->setComment( decodeUtf8( begin, end ), placement );
    }
    else
    {
       if ( !commentsBefore_.empty() )
          commentsBefore_ += L"\n";
-      commentsBefore_ += std::wstring( begin, end );
+      commentsBefore_ += decodeUtf8( begin, end );
    }
 }
 
@@ -329,10 +529,10 @@ Reader::readCStyleComment()
    while ( current_ != end_ )
    {
       Char c = getNextChar();
-      if ( c == L'*'  &&  *current_ == L'/' )
+      if ( c == '*'  &&  current_ != end_  &&  *current_ == '/' )
          break;
    }
-   return getNextChar() == L'/';
+   return getNextChar() == '/';
 }
 
 
@@ -342,7 +542,7 @@ Reader::readCppStyleComment()
    while ( current_ != end_ )
    {
       Char c = getNextChar();
-      if (  c == L'\r'  ||  c == L'\n' )
+      if (  c == '\r'  ||  c == '\n' )
          break;
    }
    return true;
@@ -354,8 +554,8 @@ Reader::readNumber()
 {
    while ( current_ != end_ )
    {
-      if ( !(*current_ >= L'0'  &&  *current_ <= L'9')  &&
-           !in( *current_, L'.', L'e', L'E', L'+', L'-' ) )
+      if ( !(*current_ >= '0'  &&  *current_ <= '9')  &&
+           !in( *current_, '.', 'e', 'E', '+', '-' ) )
          break;
       ++current_;
    }
@@ -368,12 +568,12 @@ Reader::readString()
    while ( current_ != end_ )
    {
       c = getNextChar();
-      if ( c == L'\\' )
+      if ( c == '\\' )
          getNextChar();
-      else if ( c == L'"' )
+      else if ( c == '"' )
          break;
    }
-   return c == L'"';
+   return c == '"';
 }
 
 
@@ -382,7 +582,15 @@ Reader::readObject( Token &tokenStart )
 {
    Token tokenName;
    std::wstring name;
-   currentValue() = Value( objectValue );
+   if ( handler_ )
+   {
+      if ( !handler_->startObject() )
+         return checkHandler( false, tokenStart );
+   }
+   else
+   {
+      currentValue() = Value( objectValue );
+   }
    while ( readToken( tokenName ) )
    {
       bool initialTokenOk = true;
@@ -391,7 +599,7 @@ Reader::readObject( Token &tokenStart )
       if  ( !initialTokenOk )
          break;
       if ( tokenName.type_ == tokenObjectEnd  &&  name.empty() )  // empty object
-         return true;
+         return handler_ ? checkHandler( handler_->endObject(), tokenName ) : true;
       if ( tokenName.type_ != tokenString )
          break;
       
@@ -406,10 +614,19 @@ Reader::readObject( Token &tokenStart )
                                     colon, 
                                     tokenObjectEnd );
       }
-      Value &value = currentValue()[ name ];
-      nodes_.push( &value );
-      bool ok = readValue();
-      nodes_.pop();
+      bool ok;
+      if ( handler_ )
+      {
+         ok = checkHandler( handler_->objectKey( name ), tokenName )  &&  
+              readValue();
+      }
+      else
+      {
+         Value &value = currentValue()[ name ];
+         nodes_.push( &value );
+         ok = readValue();
+         nodes_.pop();
+      }
       if ( !ok ) // error already set
          return recoverFromError( tokenObjectEnd );
 
@@ -428,7 +645,7 @@ Reader::readObject( Token &tokenStart )
               finalizeTokenOk )
          finalizeTokenOk = readToken( comma );
       if ( comma.type_ == tokenObjectEnd )
-         return true;
+         return handler_ ? checkHandler( handler_->endObject(), comma ) : true;
    }
    return addErrorAndRecover( L"Missing '}' or object member name", 
                               tokenName, 
@@ -439,24 +656,47 @@ Reader::readObject( Token &tokenStart )
 bool 
 Reader::readArray( Token &tokenStart )
 {
-   currentValue() = Value( arrayValue );
+   if ( handler_ )
+   {
+      if ( !handler_->startArray() )
+         return checkHandler( false, tokenStart );
+   }
+   else
+   {
+      currentValue() = Value( arrayValue );
+   }
+   // The depth is only restored when the array was read; an error ends
+   // the parse and the next parse starts again at zero.
+   ++arrayDepth_;
    skipSpaces();
-   if ( *current_ == L']' ) // empty array
+   if ( current_ != end_  &&  *current_ == ']' ) // empty array
    {
       Token endArray;
       readToken( endArray );
-      return true;
+      --arrayDepth_;
+      return handler_ ? checkHandler( handler_->endArray(), endArray ) : true;
    }
    int index = 0;
+   bool embedded = false;
    while ( true )
    {
-      Value &value = currentValue()[ index++ ];
-      nodes_.push( &value );
-      bool ok = readValue();
-      nodes_.pop();
+      bool ok;
+      if ( handler_ )
+      {
+         ok = embedded ? readEmbeddedDocument() : readValue();
+      }
+      else
+      {
+         Value &value = currentValue()[ index++ ];
+         nodes_.push( &value );
+         ok = embedded ? readEmbeddedDocument() : readValue();
+         nodes_.pop();
+      }
       if ( !ok ) // error already set
          return recoverFromError( tokenArrayEnd );
 
+      embedded = lastValueIsTag_;
+
       Token token;
       if ( !readToken( token ) 
            ||  ( token.type_ != tokenArraySeparator  &&  
@@ -466,9 +706,76 @@ Reader::readArray( Token &tokenStart )
                                     token, 
                                     tokenArrayEnd );
       }
-      if ( token.type_ == tokenArrayEnd || *current_ == L']' )
+      if ( token.type_ == tokenArrayEnd  ||  
+           ( current_ != end_  &&  *current_ == ']' ) )
          break;
    }
+   --arrayDepth_;
+   return handler_ ? checkHandler( handler_->endArray(), tokenStart ) : true;
+}
+
+
+bool 
+Reader::readEmbeddedDocument()
+{
+   skipSpaces();
+   if ( current_ == end_  ||  *current_ != '"' )
+      return readValue();
+
+   Token token;
+   readToken( token );
+   if ( token.type_ != tokenString )
+      return addError( L"Syntax error: value, object or array expected.", token );
+
+   // The unescaped document of every nesting level gets its own buffer.
+   // A deque is used so the buffers of the outer levels stay in place
+   // while a new level is added, and the buffers are reused over parses.
+
+   if ( embeddedDepth_ == embedded_.size() )
+      embedded_.push_back( std::string() );
+   std::string &document = embedded_[ embeddedDepth_ ];
+   document.resize( 0 );
+   if ( !unescapeString( token, document ) )
+      return false;
+
+   Location begin = begin_;
+   Location end = end_;
+   Location current = current_;
+   Location lastValueEnd = lastValueEnd_;
+   Value *lastValue = lastValue_;
+   int arrayDepth = arrayDepth_;
+   size_t errorCount = errors_.size();
+
+   begin_ = document.c_str();
+   end_ = begin_ + document.length();
+   current_ = begin_;
+   arrayDepth_ = 0;
+   ++embeddedDepth_;
+
+   bool successful = readValue();
+   if ( successful )
+   {
+      Token trailing;
+      skipCommentTokens( trailing );
+      successful = trailing.type_ == tokenEndOfStream;
+   }
+
+   --embeddedDepth_;
+   arrayDepth_ = arrayDepth;
+   begin_ = begin;
+   end_ = end;
+   current_ = current;
+   lastValueEnd_ = lastValueEnd;
+   lastValue_ = lastValue;
+
+   if ( !successful )
+   {
+      // Locations of errors in the embedded document point into the
+      // scratch buffer; report the error on the string instead.
+
+      errors_.resize( errorCount );
+      return addError( L"Embedded document is not valid JSON.", token );
+   }
    return true;
 }
 
@@ -480,13 +787,13 @@ Reader::decodeNumber( Token &token )
    for ( Location inspect = token.start_; inspect != token.end_; ++inspect )
    {
       isDouble = isDouble  
-                 ||  in( *inspect, L'.', L'e', L'E', L'+' )  
-                 ||  ( *inspect == L'-'  &&  inspect != token.start_ );
+                 ||  in( *inspect, '.', 'e', 'E', '+' )  
+                 ||  ( *inspect == '-'  &&  inspect != token.start_ );
    }
    if ( isDouble )
       return decodeDouble( token );
    Location current = token.start_;
-   bool isNegative = *current == L'-';
+   bool isNegative = *current == '-';
    if ( isNegative )
       ++current;
    Value::UInt threshold = (isNegative ? Value::UInt(-Value::minInt) 
@@ -495,11 +802,20 @@ Reader::decodeNumber( Token &token )
    while ( current < token.end_ )
    {
       Char c = *current++;
-      if ( c < L'0'  ||  c > L'9' )
+      if ( c < '0'  ||  c > '9' )
          return addError( L"'" + std::wstring( token.start_, token.end_ ) + L"' is not a number.", token );
       if ( value >= threshold )
          return decodeDouble( token );
-      value = value * 10 + Value::UInt(c - L'0');
+      value = value * 10 + Value::UInt(c - '0');
+   }
+   if ( handler_ )
+   {
+      if ( isNegative )
+         return checkHandler( handler_->intValue( -Value::Int( value ) ), token );
+      else if ( value <= Value::UInt(Value::maxInt) )
+         return checkHandler( handler_->intValue( Value::Int( value ) ), token );
+      else
+         return checkHandler( handler_->uintValue( value ), token );
    }
    if ( isNegative )
       currentValue() = -Value::Int( value );
@@ -520,31 +836,45 @@ Reader::decodeDouble( Token &token )
    int length = int(token.end_ - token.start_);
    if ( length <= bufferSize )
    {
-      Char buffer[bufferSize];
+      Char buffer[bufferSize + 1];
       memcpy( buffer, token.start_, length * sizeof(Char) );
       buffer[length] = 0;
-      count = swscanf( buffer, L"%lf", &value );
+      count = sscanf( buffer, "%lf", &value );
    }
    else
    {
-      std::wstring buffer( token.start_, token.end_ );
-      count = swscanf( buffer.c_str(), L"%lf", &value );
+      std::string buffer( token.start_, token.end_ );
+      count = sscanf( buffer.c_str(), "%lf", &value );
    }
 
    if ( count != 1 )
       return addError( L"'" + std::wstring( token.start_, token.end_ ) + L"' is not a number.", token );
+   if ( handler_ )
+      return checkHandler( handler_->doubleValue( value ), token );
    currentValue() = value;
    return true;
 }
 
 
 bool 
-Reader::decodeString( Token &token )
+Reader::decodeString( Token &token, bool &isTag )
 {
-   std::wstring decoded;
-   if ( !decodeString( token, decoded ) )
+   // The string is decoded into a buffer that is kept over values, so
+   // only the copy into the value allocates. A handler may take the
+   // contents of the buffer.
+
+   string_.resize( 0 );
+   if ( !decodeString( token, string_ ) )
       return false;
-   currentValue() = decoded;
+   // Only the level of the document that carries embedded documents is
+   // looked at, so the same string in their content is just a string.
+   isTag = !embeddedTag_.empty()  &&  
+           embeddedDepth_ == 0  &&  
+           arrayDepth_ == embeddedTagDepth_  &&  
+           string_ == embeddedTag_;
+   if ( handler_ )
+      return checkHandler( handler_->stringValue( string_ ), token );
+   currentValue() = string_;
    return true;
 }
 
@@ -558,36 +888,102 @@ Reader::decodeString( Token &token, std::wstring &decoded )
    while ( current != end )
    {
       Char c = *current++;
-      if ( c == L'"' )
+      if ( c == '"' )
          break;
-      else if ( c == L'\\' )
+      else if ( c == '\\' )
       {
          if ( current == end )
             return addError( L"Empty escape sequence in string", token, current );
          Char escape = *current++;
          switch ( escape )
          {
-         case L'"': decoded += L'"'; break;
-         case L'/': decoded += L'/'; break;
-         case L'\\': decoded += L'\\'; break;
-         case L'b': decoded += L'\b'; break;
-         case L'f': decoded += L'\f'; break;
-         case L'n': decoded += L'\n'; break;
-         case L'r': decoded += L'\r'; break;
-         case L't': decoded += L'\t'; break;
-         case L'u':
+         case '"': decoded += L'"'; break;
+         case '/': decoded += L'/'; break;
+         case '\\': decoded += L'\\'; break;
+         case 'b': decoded += L'\b'; break;
+         case 'f': decoded += L'\f'; break;
+         case 'n': decoded += L'\n'; break;
+         case 'r': decoded += L'\r'; break;
+         case 't': decoded += L'\t'; break;
+         case 'u':
             {
-               if ( !decodeUnicodeEscapeSequence( token, current, end, decoded ) )
+               unsigned int unicode;
+               if ( !decodeUnicodeEscapeSequence( token, current, end, unicode ) )
                   return false;
+               decoded += wchar_t(unicode);
             }
             break;
          default:
             return addError( L"Bad escape sequence in string", token, current );
          }
       }
+      else if ( (unsigned char)c < 0x80 )
+      {
+         decoded += wchar_t(c);
+      }
       else
       {
-         decoded += c;
+         --current;
+         appendUtf8Sequence( current, end, decoded );
+      }
+   }
+   return true;
+}
+
+
+bool 
+Reader::unescapeString( Token &token, std::string &decoded )
+{
+   decoded.reserve( token.end_ - token.start_ - 2 );
+   Location current = token.start_ + 1; // skip '"'
+   Location end = token.end_ - 1;      // do not include '"'
+   while ( current != end )
+   {
+      Location run = current;
+      while ( current != end  &&  *current != '\\'  &&  *current != '"' )
+         ++current;
+      decoded.append( run, current );
+      if ( current == end )
+         break;
+      Char c = *current++;
+      if ( c == '"' )
+         break;
+      if ( current == end )
+         return addError( L"Empty escape sequence in string", token, current );
+      Char escape = *current++;
+      switch ( escape )
+      {
+      case '"': decoded += '"'; break;
+      case '/': decoded += '/'; break;
+      case '\\': decoded += '\\'; break;
+      case 'b': decoded += '\b'; break;
+      case 'f': decoded += '\f'; break;
+      case 'n': decoded += '\n'; break;
+      case 'r': decoded += '\r'; break;
+      case 't': decoded += '\t'; break;
+      case 'u':
+         {
+            unsigned int unicode;
+            if ( !decodeUnicodeEscapeSequence( token, current, end, unicode ) )
+               return false;
+            if ( unicode >= 0xD800  &&  unicode <= 0xDBFF  &&  
+                 end - current >= 6  &&  current[0] == '\\'  &&  current[1] == 'u' )
+            {
+               Location low = current + 2;
+               unsigned int surrogate;
+               if ( !decodeUnicodeEscapeSequence( token, low, end, surrogate ) )
+                  return false;
+               if ( surrogate >= 0xDC00  &&  surrogate <= 0xDFFF )
+               {
+                  unicode = 0x10000 + ( ( unicode - 0xD800 ) << 10 ) + ( surrogate - 0xDC00 );
+                  current = low;
+               }
+            }
+            appendUtf8( unicode, decoded );
+         }
+         break;
+      default:
+         return addError( L"Bad escape sequence in string", token, current );
       }
    }
    return true;
@@ -597,29 +993,37 @@ bool
 Reader::decodeUnicodeEscapeSequence( Token &token, 
                                      Location &current, 
                                      Location end, 
-				     std::wstring &decoded )
+				     unsigned int &unicode )
 {
    if ( end - current < 4 )
       return addError( L"Bad unicode escape sequence in string: four digits expected.", token, current );
    
-   unsigned int ch = 0;
+   unicode = 0;
    
    for ( int index =0; index < 4; ++index )
    {
       Char c = *current++;
-      ch *= 16;
-      if ( c >= L'0'  &&  c <= L'9' )
-         ch += c - L'0';
-      else if ( c >= L'a'  &&  c <= L'f' )
-         ch += c - L'a' + 10;
-      else if ( c >= L'A'  &&  c <= L'F' )
-         ch += c - L'A' + 10;
+      unicode *= 16;
+      if ( c >= '0'  &&  c <= '9' )
+         unicode += c - '0';
+      else if ( c >= 'a'  &&  c <= 'f' )
+         unicode += c - 'a' + 10;
+      else if ( c >= 'A'  &&  c <= 'F' )
+         unicode += c - 'A' + 10;
       else
          return addError( L"Bad unicode escape sequence in string: hexadecimal digit expected.", token, current );
    }
 
-   decoded += ch;
+   return true;
+}
 
+
+bool 
+Reader::checkHandler( bool handled, 
+                      Token &token )
+{
+   if ( !handled )
+      return addError( L"Parsing was aborted by the handler.", token );
    return true;
 }
 
@@ -692,14 +1096,14 @@ Reader::getLocationLineAndColumn( Location location,
    while ( current < location  &&  current != end_ )
    {
       Char c = *current++;
-      if ( c == L'\r' )
+      if ( c == '\r' )
       {
-         if ( *current == L'\n' )
+         if ( *current == '\n' )
             ++current;
          lastLineStart = current;
          ++line;
       }
-      else if ( c == L'\n' )
+      else if ( c == '\n' )
       {
          lastLineStart = current;
          ++line;
@@ -739,6 +1143,135 @@ Reader::getFormatedErrorMessages() const
    return formattedMessage;
 }
 
+// Class ValueBuilder
+// //////////////////////////////////////////////////////////////////
+
+ValueBuilder::ValueBuilder( Value &root )
+   : root_( root )
+   , arena_( 0 )
+{
+}
+
+
+ValueBuilder::ValueBuilder( ValueArena &arena )
+   : root_( arena.root() )
+   , arena_( &arena )
+{
+}
+
+
+bool 
+ValueBuilder::startObject()
+{
+   ValueArena::Scope scope( arena_ );
+   Value &value = addValue();
+   value = Value( objectValue );
+   nodes_.push( &value );
+   return true;
+}
+
+
+bool 
+ValueBuilder::objectKey( const std::wstring &key )
+{
+   key_ = key;
+   return true;
+}
+
+
+bool 
+ValueBuilder::endObject()
+{
+   nodes_.pop();
+   return true;
+}
+
+
+bool 
+ValueBuilder::startArray()
+{
+   ValueArena::Scope scope( arena_ );
+   Value &value = addValue();
+   value = Value( arrayValue );
+   nodes_.push( &value );
+   return true;
+}
+
+
+bool 
+ValueBuilder::endArray()
+{
+   nodes_.pop();
+   return true;
+}
+
+
+bool 
+ValueBuilder::stringValue( std::wstring &value )
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = value;
+   return true;
+}
+
+
+bool 
+ValueBuilder::intValue( Value::Int value )
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = value;
+   return true;
+}
+
+
+bool 
+ValueBuilder::uintValue( Value::UInt value )
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = value;
+   return true;
+}
+
+
+bool 
+ValueBuilder::doubleValue( double value )
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = value;
+   return true;
+}
+
+
+bool 
+ValueBuilder::boolValue( bool value )
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = value;
+   return true;
+}
+
+
+bool 
+ValueBuilder::nullValue()
+{
+   ValueArena::Scope scope( arena_ );
+   addValue() = Value();
+   return true;
+}
+
+
+Value &
+ValueBuilder::addValue()
+{
+   if ( nodes_.empty() )
+      return root_;
+   Value &parent = *nodes_.top();
+   if ( parent.isArray() )
+      return parent[ parent.size() ];
+   return parent[ key_ ];
+}
+
+
 /*
 std::istream& operator>>( std::istream &sin, Value &root )
 {
@@ -52,6 +52,40 @@ ValueAllocator::~ValueAllocator()
 {
 }
 
+// Every allocation is aligned on this boundary.
+static const size_t arenaAlignment = 8;
+
+static size_t 
+alignArenaSize( size_t size )
+{
+   return ( size + arenaAlignment - 1 ) & ~( arenaAlignment - 1 );
+}
+
+// Every block of value storage is preceded by a header telling who owns
+// it, so releasing a block does not have to find out where it came from.
+// A block from malloc() carries its own address mixed with a key. Blocks
+// of an arena carry zero, and so does anything that is not recognised;
+// those are left alone.
+struct StorageHeader
+{
+   size_t owner_;
+};
+
+static const size_t storageHeaderSize = alignArenaSize( sizeof(StorageHeader) );
+static const size_t heapStorageKey = 0x4a534f4e;
+
+static size_t 
+heapStorageOwner( const void *storage )
+{
+   return reinterpret_cast<size_t>( storage ) ^ heapStorageKey;
+}
+
+static StorageHeader *
+storageHeader( void *storage )
+{
+   return reinterpret_cast<StorageHeader *>( static_cast<char *>( storage ) - storageHeaderSize );
+}
+
 class DefaultValueAllocator : public ValueAllocator
 {
 public:
@@ -78,7 +112,7 @@ public:
 
       if ( length == unknown )
          length = (unsigned int)wcslen(value);
-      wchar_t *newString = static_cast<wchar_t *>( malloc( ( length + 1 ) * sizeof(wchar_t) ) );
+      wchar_t *newString = static_cast<wchar_t *>( allocateStorage( ( length + 1 ) * sizeof(wchar_t) ) );
       memcpy( newString, value, length * sizeof(wchar_t) );
       newString[length] = 0;
       return newString;
@@ -86,18 +120,245 @@ public:
 
    virtual void releaseStringValue( wchar_t *value )
    {
-      if ( value )
-         free( value );
+      releaseStorage( value );
+   }
+
+   virtual void *allocateStorage( size_t size )
+   {
+      char *block = static_cast<char *>( malloc( storageHeaderSize + size ) );
+      void *storage = block + storageHeaderSize;
+      storageHeader( storage )->owner_ = heapStorageOwner( storage );
+      return storage;
+   }
+
+   virtual void releaseStorage( void *storage )
+   {
+      // Memory of an arena may be released after its scope has ended;
+      // its header tells it apart without looking at the arenas.
+
+      if ( !storage )
+         return;
+      StorageHeader *header = storageHeader( storage );
+      if ( header->owner_ != heapStorageOwner( storage ) )
+         return;
+      header->owner_ = 0;
+      free( header );
    }
 };
 
-static ValueAllocator *&valueAllocator()
+static ValueAllocator *defaultValueAllocator()
 {
    static DefaultValueAllocator defaultAllocator;
-   static ValueAllocator *valueAllocator = &defaultAllocator;
-   return valueAllocator;
+   return &defaultAllocator;
+}
+
+// The current allocator is kept per thread, so a thread that parses
+// into an arena does not take the allocations of other threads with it.
+static __declspec(thread) ValueAllocator *currentValueAllocator = 0;
+
+static ValueAllocator *valueAllocator()
+{
+   ValueAllocator *allocator = currentValueAllocator;
+   return allocator ? allocator : defaultValueAllocator();
+}
+
+void *
+allocateValueStorage( size_t size )
+{
+   return valueAllocator()->allocateStorage( size );
+}
+
+void 
+releaseValueStorage( void *storage )
+{
+   // Storage may be released while another allocator is current. The
+   // default allocator tells from its header whether it is its own.
+
+   defaultValueAllocator()->releaseStorage( storage );
 }
 
+
+
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// class ValueArena
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+// //////////////////////////////////////////////////////////////////
+
+ValueArena::Scope::Scope( ValueArena *arena )
+   : previous_( currentValueAllocator )
+{
+   if ( arena )
+      currentValueAllocator = arena;
+}
+
+
+ValueArena::Scope::~Scope()
+{
+   currentValueAllocator = previous_;
+}
+
+
+ValueArena::ValueArena( unsigned int pageSize )
+   : pages_( 0 )
+   , spare_( 0 )
+   , pageSize_( pageSize )
+{
+}
+
+
+ValueArena::~ValueArena()
+{
+   clear();
+   releasePages( spare_, false );
+   spare_ = 0;
+}
+
+
+Value &
+ValueArena::root()
+{
+   return root_;
+}
+
+
+void 
+ValueArena::clear()
+{
+   // Destroying the tree releases nothing back into the pages; they are
+   // rewound as a whole instead. Pages of the default size are kept for
+   // the next parse.
+
+   root_ = Value();
+
+   Page *pages = pages_;
+   pages_ = 0;
+
+   releasePages( pages, true );
+}
+
+
+wchar_t *
+ValueArena::makeMemberName( const wchar_t *memberName )
+{
+   return duplicateStringValue( memberName );
+}
+
+
+void 
+ValueArena::releaseMemberName( wchar_t *memberName )
+{
+   releaseStorage( memberName );
+}
+
+
+wchar_t *
+ValueArena::duplicateStringValue( const wchar_t *value, 
+                                  unsigned int length )
+{
+   if ( length == unknown )
+      length = (unsigned int)wcslen(value);
+   wchar_t *newString = static_cast<wchar_t *>( allocateStorage( ( length + 1 ) * sizeof(wchar_t) ) );
+   memcpy( newString, value, length * sizeof(wchar_t) );
+   newString[length] = 0;
+   return newString;
+}
+
+
+void 
+ValueArena::releaseStringValue( wchar_t *value )
+{
+   releaseStorage( value );
+}
+
+
+void *
+ValueArena::allocateStorage( size_t size )
+{
+   const size_t header = alignArenaSize( sizeof(Page) );
+   size = storageHeaderSize + alignArenaSize( size );
+
+   if ( !pages_  ||  pages_->used_ + size > pages_->size_ )
+   {
+      Page *page = 0;
+      if ( spare_  &&  size <= spare_->size_ )
+      {
+         page = spare_;
+         spare_ = page->next_;
+      }
+      else
+      {
+         // Large values get a page of their own.
+         size_t pageSize = size > pageSize_ ? size : pageSize_;
+         page = static_cast<Page *>( malloc( header + pageSize ) );
+         page->size_ = pageSize;
+      }
+      page->used_ = 0;
+      page->next_ = pages_;
+      pages_ = page;
+   }
+
+   void *storage = reinterpret_cast<char *>( pages_ ) + header + pages_->used_ + storageHeaderSize;
+   pages_->used_ += size;
+   storageHeader( storage )->owner_ = 0;
+   return storage;
+}
+
+
+void 
+ValueArena::releaseStorage( void *storage )
+{
+   // Memory of the arena is returned by clear(). Anything else was
+   // allocated before the arena was in scope.
+
+   defaultValueAllocator()->releaseStorage( storage );
+}
+
+
+void 
+ValueArena::releasePages( Page *pages, bool keep )
+{
+   while ( pages )
+   {
+      Page *next = pages->next_;
+      if ( keep  &&  pages->size_ == pageSize_ )
+      {
+         pages->next_ = spare_;
+         spare_ = pages;
+      }
+      else
+         free( pages );
+      pages = next;
+   }
+}
+
+
+#ifndef JSON_VALUE_USE_INTERNAL_MAP
+static Value::ObjectValues *
+newObjectValues()
+{
+   void *storage = allocateValueStorage( sizeof(Value::ObjectValues) );
+   return new( storage ) Value::ObjectValues();
+}
+
+static Value::ObjectValues *
+newObjectValuesCopy( const Value::ObjectValues &other )
+{
+   void *storage = allocateValueStorage( sizeof(Value::ObjectValues) );
+   return new( storage ) Value::ObjectValues( other );
+}
+
+static void 
+deleteObjectValues( Value::ObjectValues *map )
+{
+   typedef Value::ObjectValues ObjectValues;
+   map->~ObjectValues();
+   releaseValueStorage( map );
+}
+#endif // ifndef JSON_VALUE_USE_INTERNAL_MAP
+
 static struct DummyValueAllocatorInitializer {
    DummyValueAllocatorInitializer() 
    {
@@ -286,7 +547,7 @@ Value::Value( ValueType type )
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      value_.map_ = new ObjectValues();
+      value_.map_ = newObjectValues();
       break;
 #else
    case arrayValue:
@@ -424,7 +685,7 @@ Value::Value( const Value &other )
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      value_.map_ = new ObjectValues( *other.value_.map_ );
+      value_.map_ = newObjectValuesCopy( *other.value_.map_ );
       break;
 #else
    case arrayValue:
@@ -467,7 +728,7 @@ Value::~Value()
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
    case arrayValue:
    case objectValue:
-      delete value_.map_;
+      deleteObjectValues( value_.map_ );
       break;
 #else
    case arrayValue:
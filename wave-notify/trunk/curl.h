@@ -22,9 +22,28 @@
 
 #define MAX_AUTO_REDIRECT	30
 
+// Result a request is completed with when it was cancelled, and the
+// result of a request that has not completed yet.
+
+#define CURL_RESULT_CANCELLED	((CURLcode)-1)
+#define CURL_RESULT_PENDING	((CURLcode)-2)
+
+// Received data waiting for the reader thread is capped at this size
+// (in bytes). The curl thread waits for the reader thread above it.
+
+#define CURL_READER_QUEUE_LIMIT	(4 * 1024 * 1024)
+
+// Finished easy handles are kept for reuse, so their connections and SSL
+// sessions are reused too. At most this many idle handles are kept per
+// host, and for at most this long (in milliseconds).
+
+#define CURL_POOL_MAX_IDLE	4
+#define CURL_POOL_IDLE_TIMEOUT	(60 * 1000)
+
 class CCurlReader;
 class CCurlCookies;
 class CCurl;
+class CCurlReaderThread;
 
 typedef vector<CCurl *> TCurlVector;
 typedef TCurlVector::iterator TCurlVectorIter;
@@ -32,16 +51,39 @@ typedef TCurlVector::const_iterator TCurlVectorConstIter;
 
 typedef enum
 {
-	CR_COMPLETED,
-	CR_DATA_RECEIVED
+	CR_COMPLETED
 } CURL_RESPONSE;
 
-typedef struct tagCURL_DATA_RECEIVED
+typedef enum
+{
+	CCT_DATA,
+	CCT_COMPLETED
+} CURL_CHUNK_TYPE;
+
+typedef struct tagCURL_CHUNK
 {
+	struct tagCURL_CHUNK * lpNext;
+	CURL_CHUNK_TYPE nType;
+	CCurl * lpCurl;
 	CCurlReader * lpReader;
+	CURLcode nCode;
+	LONG lStatus;
 	DWORD cbData;
 	LPBYTE lpData;
-} CURL_DATA_RECEIVED, * LPCURL_DATA_RECEIVED;
+} CURL_CHUNK, * LPCURL_CHUNK;
+
+typedef struct tagCURL_SOCKET
+{
+	SOCKET hSocket;
+	INT nEvents;
+} CURL_SOCKET, * LPCURL_SOCKET;
+
+typedef struct tagCURL_POOL_HANDLE
+{
+	CURL * lpCurl;
+	string szHost;
+	DWORD dwReleased;
+} CURL_POOL_HANDLE, * LPCURL_POOL_HANDLE;
 
 class CCurlReader
 {
@@ -81,6 +123,35 @@ public:
 	wstring GetPassword() const { return m_szPassword; }
 };
 
+class CCurlHandlePool
+{
+	typedef vector<CURL_POOL_HANDLE> THandleVector;
+	typedef THandleVector::iterator THandleVectorIter;
+	typedef THandleVector::const_iterator THandleVectorConstIter;
+
+private:
+	static CLock m_vLock;
+	static THandleVector m_vHandles;
+	static volatile LONG m_lRequests;
+	static volatile LONG m_lConnects;
+	static volatile LONG m_lHits;
+	static volatile LONG m_lMisses;
+
+public:
+	static CURL * Acquire(const char * szUrl);
+	static void Release(CURL * lpCurl, const char * szUrl, BOOL fReusable);
+	static void Clear();
+
+	static LONG GetRequests() { return m_lRequests; }
+	static LONG GetConnects() { return m_lConnects; }
+	static LONG GetHits() { return m_lHits; }
+	static LONG GetMisses() { return m_lMisses; }
+
+private:
+	static string GetHost(const char * szUrl);
+	static void Expire(DWORD dwNow);
+};
+
 class CCurl
 {
 private:
@@ -102,6 +173,9 @@ private:
 	BOOL m_fAutoRedirect;
 	BOOL m_fIgnoreSSLErrors;
 	INT m_nTimeout;
+	CCurlReaderThread * m_lpReaderThread;
+	volatile LONG m_lReadFailed;
+	volatile LONG m_lCancelled;
 
 	static CCurlProxySettings * m_lpProxySettings;
 
@@ -137,6 +211,7 @@ public:
 	static void SetProxySettings(CCurlProxySettings * lpProxySettings) {
 		if (m_lpProxySettings != NULL) delete m_lpProxySettings;
 		m_lpProxySettings = lpProxySettings;
+		CCurlHandlePool::Clear();
 	};
 	static void Destroy(CCurl * lpCurl) {
 		ASSERT(lpCurl != NULL);
@@ -153,6 +228,7 @@ public:
 		ASSERT(nResult == CURLE_OK);
 	}
 	static void GlobalCleanup() {
+		CCurlHandlePool::Clear();
 		curl_global_cleanup();
 	}
 
@@ -163,6 +239,10 @@ private:
 	static size_t WriteDataCallback(void * lpData, size_t dwSize, size_t dwBlocks, void * lpStream);
 	static size_t WriteHeaderCallback(void * lpData, size_t dwSize, size_t dwBlocks, void * lpStream);
 	static INT DebugCallback(CURL * lpCurl, curl_infotype nInfoType, LPCSTR szMessage, size_t cbMessage, LPVOID lpParam);
+
+private:
+	friend class CCurlMonitor;
+	friend class CCurlReaderThread;
 };
 
 class CCurlCookies
@@ -247,35 +327,41 @@ public:
 
 class CCurlMulti
 {
-	typedef map<SOCKET, INT> TSocketMap;
-	typedef TSocketMap::iterator TSocketMapIter;
-	typedef TSocketMap::const_iterator TSocketMapConstIter;
+	typedef vector<CURL_SOCKET> TSocketVector;
+	typedef TSocketVector::iterator TSocketVectorIter;
+	typedef TSocketVector::const_iterator TSocketVectorConstIter;
 
 private:
 	CURLM * m_lpMulti;
 	INT m_nRunning;
+	CWSAEvent m_vEvent;
+	TSocketVector m_vSockets;
+	TSocketVector m_vPending;
+	BOOL m_fReselect;
 
 public:
 	CCurlMulti() {
 		if (( m_lpMulti = curl_multi_init() ) == NULL)
 			FAIL("Could not initialise curl_multi_init");
 		m_nRunning = 0;
+		m_fReselect = FALSE;
 	}
 	virtual ~CCurlMulti() { curl_multi_cleanup(m_lpMulti); }
 
 	void Add(CCurl * lpCurl) {
 		if (curl_multi_add_handle(m_lpMulti, lpCurl->GetHandle()) != CURLE_OK)
 			FAIL("Could not curl_multi_add_handle");
+		m_fReselect = TRUE;
 	}
 	void Remove(CCurl * lpCurl) {
-		if (curl_multi_remove_handle(m_lpMulti, lpCurl->GetHandle()) != CURLE_OK)
-			LOG("Could not curl_multi_remove_handle");
+		Remove(lpCurl->GetHandle());
 	}
 	void Remove(CURL * lpCurl) {
 		if (curl_multi_remove_handle(m_lpMulti, lpCurl) != CURLE_OK)
 			LOG("Could not curl_multi_remove_handle");
+		m_fReselect = TRUE;
 	}
-	CWSAEvent * GetEvent();
+	CWSAEvent * UpdateEvent();
 	void Perform();
 	CURLMsg * GetNextMessage() {
 		int nRemaining;
@@ -284,19 +370,28 @@ public:
 	INT GetRunning() const { return m_nRunning; }
 	
 private:
-	void AddSockets(TSocketMap & vSockets, fd_set & vSet, INT nEventType);
+	void AddSockets(TSocketVector & vSockets, fd_set & vSet, INT nEventType);
+	static bool CompareSockets(const CURL_SOCKET & vLeft, const CURL_SOCKET & vRight) {
+		return vLeft.hSocket < vRight.hSocket;
+	}
 };
 
 class CCurlCache
 {
 private:
 	CURLSH * m_lpShare;
+	CLock m_vLocks[CURL_LOCK_DATA_LAST];
 
 public:
 	CCurlCache() {
 		if (( m_lpShare = curl_share_init() ) == NULL)
 			FAIL("Could not curl_share_init");
+		curl_share_setopt(m_lpShare, CURLSHOPT_LOCKFUNC, CCurlCache::LockCallback);
+		curl_share_setopt(m_lpShare, CURLSHOPT_UNLOCKFUNC, CCurlCache::UnlockCallback);
+		curl_share_setopt(m_lpShare, CURLSHOPT_USERDATA, this);
 		curl_share_setopt(m_lpShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		// SSL sessions are not shared; this version of curl refuses to.
+		// The easy handle pool keeps them with the handle instead.
 	}
 	virtual ~CCurlCache() { curl_share_cleanup(m_lpShare); }
 
@@ -308,6 +403,39 @@ public:
 		if (curl_easy_setopt(lpCurl->GetHandle(), CURLOPT_SHARE, NULL) != CURLE_OK)
 			LOG("Could not curl_easy_setopt(CURLOPT_SHARE, 0)");
 	}
+
+private:
+	static void LockCallback(CURL * lpCurl, curl_lock_data nData, curl_lock_access nAccess, void * lpUserData) {
+		((CCurlCache *)lpUserData)->m_vLocks[nData].Enter();
+	}
+	static void UnlockCallback(CURL * lpCurl, curl_lock_data nData, void * lpUserData) {
+		((CCurlCache *)lpUserData)->m_vLocks[nData].Leave();
+	}
+};
+
+class CCurlReaderThread : private CThread
+{
+private:
+	CAutoResetEvent m_vEvent;
+	CAutoResetEvent m_vDrainedEvent;
+	volatile BOOL m_fStopping;
+	LPCURL_CHUNK volatile m_lpChunks;
+	volatile LONG m_lQueued;
+
+public:
+	CCurlReaderThread();
+	virtual ~CCurlReaderThread();
+
+	void QueueData(CCurl * lpCurl, LPBYTE lpData, DWORD cbData);
+	void QueueCompleted(CCurl * lpCurl, CURLcode nCode, LONG lStatus);
+
+protected:
+	DWORD ThreadProc();
+
+private:
+	void QueueChunk(LPCURL_CHUNK lpChunk);
+	LPCURL_CHUNK TakeChunks();
+	void ProcessChunks(LPCURL_CHUNK lpChunks);
 };
 
 class CCurlMonitor : private CThread
@@ -322,6 +450,7 @@ private:
 	CWindowHandle * m_lpTargetWindow;
 	CCurlCache m_vCache;
 	CCurlMulti * m_lpMulti;
+	CCurlReaderThread m_vReaderThread;
 
 public:
 	CCurlMonitor(CWindowHandle * lpTargetWindow);
@@ -353,6 +482,11 @@ public:
 		ASSERT(find(m_vCancelRequests.begin(), m_vCancelRequests.end(), lpRequest) == m_vCancelRequests.end());
 		m_vCancelRequests.push_back(lpRequest);
 
+		// Data of the request that is still waiting for the reader thread
+		// is dropped from here on.
+
+		InterlockedExchange(&lpRequest->m_lCancelled, TRUE);
+
 		m_vLock.Leave();
 
 		m_vEvent.Set();
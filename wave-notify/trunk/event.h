@@ -93,12 +93,24 @@ public:
 		CHECK_HANDLE(hSocket);
 		CHECK_GT_0(nEventType);
 
-		m_vSockets.push_back(hSocket);
+		if (find(m_vSockets.begin(), m_vSockets.end(), hSocket) == m_vSockets.end())
+			m_vSockets.push_back(hSocket);
 		int nResult = WSAEventSelect(hSocket, m_hEvent, nEventType);
 
 		if (nResult == SOCKET_ERROR)
 			FAIL("Call to WSAEventSelect failed");
 	}
+	void EventDeselect(SOCKET hSocket) {
+		CHECK_HANDLE(hSocket);
+
+		TSocketVectorIter pos = find(m_vSockets.begin(), m_vSockets.end(), hSocket);
+		if (pos != m_vSockets.end())
+			m_vSockets.erase(pos);
+
+		// The socket may already have been closed, so errors are ignored.
+
+		WSAEventSelect(hSocket, m_hEvent, 0);
+	}
 };
 
 #endif // _INC_EVENT
@@ -30,6 +30,15 @@
 // Turn this on to route automatic update requests to a local server.
 #define TEST_AUTOMATIC_UPDATE	1
 
+// Turn this on to route the Wave requests to a local stand-in server.
+// #define TEST_LOCAL_WAVE	1
+
+// Turn this on to record the channel traffic to channel-trace.bin.
+// #define TEST_CHANNEL_TRACE	1
+
+// Turn this on to replay channel-trace.bin instead of signing in.
+// #define TEST_CHANNEL_REPLAY	1
+
 // Turn this on to break every time a LOG(n) is called.
 #define BREAK_ON_LOG		1
 
@@ -106,6 +115,10 @@ typedef enum
 
 #define TIMER_RECONNECT_INTERVAL_INITIAL	(5 * 1000)
 #define TIMER_RECONNECT_INTERVAL_MAX		(60 * 1000)
+#define TIMER_RECONNECT_CHANNEL_INITIAL		500
+#define TIMER_RECONNECT_CHANNEL_MAX		(5 * 1000)
+#define TIMER_RECONNECT_SID_INITIAL		(1 * 1000)
+#define TIMER_RECONNECT_SID_MAX			(10 * 1000)
 
 #define TIMER_REREPORT_TIMEOUT			(3 * 60 * 1000)
 
@@ -119,6 +132,7 @@ typedef enum
 #include "gdi.h"
 #include "colorscheme.h"
 #include "lock.h"
+#include "stringpool.h"
 #include "registry.h"
 #include "support.h"
 #include "delegate.h"
@@ -9,6 +9,10 @@
 /// If defined, indicates that cpptl vector based map should be used instead of std::map
 /// as Value container.
 //#  define JSON_USE_CPPTL_SMALLMAP 1
+/// If defined, indicates that a sorted vector of member pointers with inline storage
+/// should be used instead of std::map as Value container (see json_flatmap.h).
+/// Larger objects get a hash index on their member names.
+#  define JSON_USE_FLAT_MAP 1
 /// If defined, indicates that Json specific container should be used
 /// (hash table & simple deque container with customizable allocator).
 /// THIS FEATURE IS STILL EXPERIMENTAL!
@@ -0,0 +1,471 @@
+#ifndef JSONCPP_FLATMAP_H_INCLUDED
+# define JSONCPP_FLATMAP_H_INCLUDED
+
+# include "json_forwards.h"
+# include <cstddef>
+# include <cstring>
+# include <new>
+# include <utility>
+# include <algorithm>
+# include <iterator>
+
+/// Number of member pointers stored within the map itself before storage is allocated.
+# ifndef JSON_FLAT_MAP_INLINE_SIZE
+#  define JSON_FLAT_MAP_INLINE_SIZE 8
+# endif
+/// Number of members above which objects keep a hash index of their member names.
+# ifndef JSON_FLAT_MAP_INDEX_THRESHOLD
+#  define JSON_FLAT_MAP_INDEX_THRESHOLD 16
+# endif
+
+# ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
+
+namespace Json {
+
+   // Also declared in json_value.h; repeated so this header stands on its own.
+   JSON_API void *allocateValueStorage( size_t size );
+   JSON_API void releaseValueStorage( void *storage );
+
+/* Random access iterator over the sorted member pointers of a ValueFlatMap.
+ */
+template<typename Item>
+class ValueFlatMapIterator
+{
+public:
+   typedef std::random_access_iterator_tag iterator_category;
+   typedef Item value_type;
+   typedef ptrdiff_t difference_type;
+   typedef Item *pointer;
+   typedef Item &reference;
+
+   ValueFlatMapIterator()
+      : current_( 0 )
+   {
+   }
+
+   explicit ValueFlatMapIterator( Item * const *current )
+      : current_( current )
+   {
+   }
+
+   template<typename Other>
+   ValueFlatMapIterator( const ValueFlatMapIterator<Other> &other )
+      : current_( other.base() )
+   {
+   }
+
+   Item * const *base() const
+   {
+      return current_;
+   }
+
+   reference operator *() const
+   {
+      return **current_;
+   }
+
+   pointer operator ->() const
+   {
+      return *current_;
+   }
+
+   ValueFlatMapIterator &operator ++()
+   {
+      ++current_;
+      return *this;
+   }
+
+   ValueFlatMapIterator operator ++( int )
+   {
+      ValueFlatMapIterator result( *this );
+      ++current_;
+      return result;
+   }
+
+   ValueFlatMapIterator &operator --()
+   {
+      --current_;
+      return *this;
+   }
+
+   ValueFlatMapIterator operator --( int )
+   {
+      ValueFlatMapIterator result( *this );
+      --current_;
+      return result;
+   }
+
+   ValueFlatMapIterator operator +( difference_type offset ) const
+   {
+      return ValueFlatMapIterator( current_ + offset );
+   }
+
+   ValueFlatMapIterator operator -( difference_type offset ) const
+   {
+      return ValueFlatMapIterator( current_ - offset );
+   }
+
+   template<typename Other>
+   difference_type operator -( const ValueFlatMapIterator<Other> &other ) const
+   {
+      return difference_type( current_ - other.base() );
+   }
+
+   template<typename Other>
+   bool operator ==( const ValueFlatMapIterator<Other> &other ) const
+   {
+      return current_ == other.base();
+   }
+
+   template<typename Other>
+   bool operator !=( const ValueFlatMapIterator<Other> &other ) const
+   {
+      return current_ != other.base();
+   }
+
+private:
+   Item * const *current_;
+};
+
+
+/* Sorted vector based map used as Value container.
+ *
+ * The map keeps a sorted array of pointers to its members and looks keys up
+ * with a binary search. The first JSON_FLAT_MAP_INLINE_SIZE pointers are
+ * stored within the map itself. Members and larger pointer arrays take their
+ * storage from allocateValueStorage(), so during a parse into a ValueArena
+ * they are bump allocated next to each other.
+ *
+ * Members are allocated one by one so references to them stay valid when
+ * other members are inserted or erased, like they do with std::map; callers
+ * rely on that when they take several references through operator[].
+ * Iterators do not survive an insertion or erasure.
+ *
+ * Arrays are stored with their index as key and are nearly always dense, so
+ * an index is first tried as a position. Objects with more than
+ * JSON_FLAT_MAP_INDEX_THRESHOLD members keep an open addressing hash index
+ * from member name to position.
+ */
+template<typename Key, typename T>
+class ValueFlatMap
+{
+public:
+   typedef Key key_type;
+   typedef T mapped_type;
+   typedef std::pair<Key, T> value_type;
+   typedef ValueFlatMapIterator<value_type> iterator;
+   typedef ValueFlatMapIterator<const value_type> const_iterator;
+   typedef unsigned int size_type;
+
+   ValueFlatMap()
+      : items_( inline_ )
+      , size_( 0 )
+      , capacity_( JSON_FLAT_MAP_INLINE_SIZE )
+      , hashes_( 0 )
+      , hashCapacity_( 0 )
+   {
+   }
+
+   ValueFlatMap( const ValueFlatMap &other )
+      : items_( inline_ )
+      , size_( 0 )
+      , capacity_( JSON_FLAT_MAP_INLINE_SIZE )
+      , hashes_( 0 )
+      , hashCapacity_( 0 )
+   {
+      copy( other );
+   }
+
+   ~ValueFlatMap()
+   {
+      clear();
+      if ( items_ != inline_ )
+         releaseValueStorage( items_ );
+   }
+
+   ValueFlatMap &operator =( const ValueFlatMap &other )
+   {
+      if ( this != &other )
+      {
+         clear();
+         copy( other );
+      }
+      return *this;
+   }
+
+   size_type size() const
+   {
+      return size_;
+   }
+
+   bool empty() const
+   {
+      return size_ == 0;
+   }
+
+   iterator begin()
+   {
+      return iterator( items_ );
+   }
+
+   iterator end()
+   {
+      return iterator( items_ + size_ );
+   }
+
+   const_iterator begin() const
+   {
+      return const_iterator( items_ );
+   }
+
+   const_iterator end() const
+   {
+      return const_iterator( items_ + size_ );
+   }
+
+   void clear()
+   {
+      for ( size_type position = 0; position < size_; ++position )
+         destroyItem( items_[position] );
+      size_ = 0;
+      releaseHashes();
+   }
+
+   iterator find( const key_type &key )
+   {
+      return iterator( items_ + findPosition( key ) );
+   }
+
+   const_iterator find( const key_type &key ) const
+   {
+      return const_iterator( items_ + findPosition( key ) );
+   }
+
+   iterator lower_bound( const key_type &key )
+   {
+      return iterator( items_ + lowerBoundPosition( key ) );
+   }
+
+   const_iterator lower_bound( const key_type &key ) const
+   {
+      return const_iterator( items_ + lowerBoundPosition( key ) );
+   }
+
+   /// Inserts value before hint, which should be the lower bound of its key.
+   /// Returns the existing member when the key is already present.
+   iterator insert( iterator hint, const value_type &value )
+   {
+      size_type position = size_type( hint.base() - items_ );
+      if ( position > size_
+           ||  ( position < size_  &&  items_[position]->first < value.first )
+           ||  ( position > 0  &&  !( items_[position - 1]->first < value.first ) ) )
+         position = lowerBoundPosition( value.first );
+      if ( position < size_  &&  items_[position]->first == value.first )
+         return iterator( items_ + position );
+
+      value_type *item = new( allocateValueStorage( sizeof(value_type) ) ) value_type( value );
+      if ( size_ == capacity_ )
+         reserve( capacity_ * 2 );
+      if ( position < size_ )
+         std::memmove( items_ + position + 1, items_ + position, ( size_ - position ) * sizeof(value_type *) );
+      items_[position] = item;
+      ++size_;
+
+      if ( position + 1 == size_  &&  hashes_ )
+         addHash( position );
+      else
+         updateHashes();
+      return iterator( items_ + position );
+   }
+
+   void erase( iterator it )
+   {
+      size_type position = size_type( it.base() - items_ );
+      destroyItem( items_[position] );
+      --size_;
+      if ( position < size_ )
+         std::memmove( items_ + position, items_ + position + 1, ( size_ - position ) * sizeof(value_type *) );
+      updateHashes();
+   }
+
+   size_type erase( const key_type &key )
+   {
+      size_type position = findPosition( key );
+      if ( position == size_ )
+         return 0;
+      erase( iterator( items_ + position ) );
+      return 1;
+   }
+
+private:
+   void copy( const ValueFlatMap &other )
+   {
+      if ( other.size_ > capacity_ )
+         reserve( other.size_ );
+      for ( ; size_ < other.size_; ++size_ )
+         items_[size_] = new( allocateValueStorage( sizeof(value_type) ) ) value_type( *other.items_[size_] );
+      updateHashes();
+   }
+
+   void reserve( size_type capacity )
+   {
+      value_type **items = static_cast<value_type **>( allocateValueStorage( capacity * sizeof(value_type *) ) );
+      if ( size_ )
+         std::memcpy( items, items_, size_ * sizeof(value_type *) );
+      if ( items_ != inline_ )
+         releaseValueStorage( items_ );
+      items_ = items;
+      capacity_ = capacity;
+   }
+
+   static void destroyItem( value_type *item )
+   {
+      item->~value_type();
+      releaseValueStorage( item );
+   }
+
+   static bool isIndex( const key_type &key )
+   {
+      return key.c_str() == 0;
+   }
+
+   size_type lowerBoundPosition( const key_type &key ) const
+   {
+      if ( size_ == 0  ||  items_[size_ - 1]->first < key )
+         return size_;
+      if ( isIndex( key ) )
+      {
+         size_type index = size_type( key.index() );
+         if ( index < size_  &&  isIndex( items_[index]->first )  &&  items_[index]->first.index() == key.index() )
+            return index;
+      }
+      else if ( hashes_ )
+      {
+         size_type position = hashPosition( key );
+         if ( position < size_ )
+            return position;
+      }
+      size_type first = 0;
+      size_type count = size_;
+      while ( count > 0 )
+      {
+         size_type half = count / 2;
+         if ( items_[first + half]->first < key )
+         {
+            first += half + 1;
+            count -= half + 1;
+         }
+         else
+            count = half;
+      }
+      return first;
+   }
+
+   size_type findPosition( const key_type &key ) const
+   {
+      if ( hashes_  &&  !isIndex( key ) )
+         return hashPosition( key );
+      size_type position = lowerBoundPosition( key );
+      if ( position < size_  &&  items_[position]->first == key )
+         return position;
+      return size_;
+   }
+
+   static size_type hashKey( const key_type &key )
+   {
+      // FNV-1a over the characters of the member name.
+      size_type hash = 2166136261u;
+      for ( const wchar_t *current = key.c_str(); *current; ++current )
+      {
+         hash ^= size_type( *current );
+         hash *= 16777619u;
+      }
+      return hash;
+   }
+
+   size_type hashPosition( const key_type &key ) const
+   {
+      size_type mask = hashCapacity_ - 1;
+      for ( size_type slot = hashKey( key ) & mask; hashes_[slot]; slot = ( slot + 1 ) & mask )
+      {
+         if ( items_[hashes_[slot] - 1]->first == key )
+            return hashes_[slot] - 1;
+      }
+      return size_;
+   }
+
+   void addHash( size_type position )
+   {
+      if ( size_ * 2 > hashCapacity_ )
+      {
+         updateHashes();
+         return;
+      }
+      size_type mask = hashCapacity_ - 1;
+      size_type slot = hashKey( items_[position]->first ) & mask;
+      while ( hashes_[slot] )
+         slot = ( slot + 1 ) & mask;
+      hashes_[slot] = position + 1;
+   }
+
+   /// Rebuilds the hash index after positions changed, or drops it when the
+   /// map is small enough to do without.
+   void updateHashes()
+   {
+      releaseHashes();
+      if ( size_ <= JSON_FLAT_MAP_INDEX_THRESHOLD  ||  isIndex( items_[0]->first ) )
+         return;
+
+      hashCapacity_ = 4;
+      while ( hashCapacity_ < size_ * 4 )
+         hashCapacity_ *= 2;
+      hashes_ = static_cast<size_type *>( allocateValueStorage( hashCapacity_ * sizeof(size_type) ) );
+      std::memset( hashes_, 0, hashCapacity_ * sizeof(size_type) );
+
+      size_type mask = hashCapacity_ - 1;
+      for ( size_type position = 0; position < size_; ++position )
+      {
+         size_type slot = hashKey( items_[position]->first ) & mask;
+         while ( hashes_[slot] )
+            slot = ( slot + 1 ) & mask;
+         hashes_[slot] = position + 1;
+      }
+   }
+
+   void releaseHashes()
+   {
+      if ( hashes_ )
+         releaseValueStorage( hashes_ );
+      hashes_ = 0;
+      hashCapacity_ = 0;
+   }
+
+   value_type **items_;
+   size_type size_;
+   size_type capacity_;
+   /// Open addressing table of positions + 1 into items_; 0 marks a free slot.
+   size_type *hashes_;
+   size_type hashCapacity_;
+   value_type *inline_[JSON_FLAT_MAP_INLINE_SIZE];
+};
+
+
+template<typename Key, typename T>
+bool operator ==( const ValueFlatMap<Key, T> &left, const ValueFlatMap<Key, T> &right )
+{
+   return left.size() == right.size()
+          &&  std::equal( left.begin(), left.end(), right.begin() );
+}
+
+template<typename Key, typename T>
+bool operator <( const ValueFlatMap<Key, T> &left, const ValueFlatMap<Key, T> &right )
+{
+   return std::lexicographical_compare( left.begin(), left.end(), right.begin(), right.end() );
+}
+
+
+} // namespace Json
+
+# endif // ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
+
+#endif // JSONCPP_FLATMAP_H_INCLUDED
@@ -12,6 +12,70 @@ namespace Json {
 
    class Value;
 
+   /** \brief Receives the events of a document read by Reader.
+    *
+    * Reader::parse() with a handler reports the document as a stream of events
+    * instead of building a Value tree. Every event returns \c false to abort
+    * parsing.
+    */
+   class JSON_API ReaderHandler
+   {
+   public:
+      virtual ~ReaderHandler();
+
+      virtual bool startObject() = 0;
+      virtual bool objectKey( const std::wstring &key ) = 0;
+      virtual bool endObject() = 0;
+      virtual bool startArray() = 0;
+      virtual bool endArray() = 0;
+
+      /// \param value Decoded string. The handler may take the contents,
+      ///              e.g. by swapping it with a string of its own.
+      virtual bool stringValue( std::wstring &value ) = 0;
+      virtual bool intValue( Value::Int value ) = 0;
+      virtual bool uintValue( Value::UInt value ) = 0;
+      virtual bool doubleValue( double value ) = 0;
+      virtual bool boolValue( bool value ) = 0;
+      virtual bool nullValue() = 0;
+   };
+
+   /** \brief ReaderHandler that builds a Value tree from the events it receives.
+    *
+    * Allows a handler to fall back to a Value tree for part of a document by
+    * forwarding the events of that part.
+    */
+   class JSON_API ValueBuilder : public ReaderHandler
+   {
+   public:
+      ValueBuilder( Value &root );
+
+      /** \brief Builds the values into the root of \c arena, taking all their
+       *         memory from the arena.
+       */
+      ValueBuilder( ValueArena &arena );
+
+      virtual bool startObject();
+      virtual bool objectKey( const std::wstring &key );
+      virtual bool endObject();
+      virtual bool startArray();
+      virtual bool endArray();
+      virtual bool stringValue( std::wstring &value );
+      virtual bool intValue( Value::Int value );
+      virtual bool uintValue( Value::UInt value );
+      virtual bool doubleValue( double value );
+      virtual bool boolValue( bool value );
+      virtual bool nullValue();
+
+   private:
+      Value &addValue();
+
+      typedef std::stack<Value *> Nodes;
+      Nodes nodes_;
+      std::wstring key_;
+      Value &root_;
+      ValueArena *arena_;
+   };
+
    /** \brief Unserialize a <a HREF="http://www.json.org">JSON</a> document into a Value.
     *
     *
@@ -19,13 +83,14 @@ namespace Json {
    class JSON_API Reader
    {
    public:
-      typedef wchar_t Char;
+      typedef char Char;
       typedef const Char *Location;
 
       Reader();
 
       /** \brief Read a Value from a <a HREF="http://www.json.org">JSON</a> document.
-       * \param document UTF-8 encoded string containing the document to read.
+       * \param document Wide string containing the document to read. It is
+       *                 encoded to UTF-8 before it is parsed.
        * \param root [out] Contains the root value of the document if it was
        *             successfully parsed.
        * \param collectComments \c true to collect comment and allow writing them back during
@@ -44,9 +109,46 @@ namespace Json {
        *                        serialization, \c false to discard comments.
        * \return \c true if the document was successfully parsed, \c false if an error occurred.
        */
-      bool parse( const wchar_t *beginDoc, const wchar_t *endDoc, 
+      bool parse( const std::string &document, 
                   Value &root,
                   bool collectComments = true );
+
+      /** \brief Read a Value from a <a HREF="http://www.json.org">JSON</a> document.
+       * \param document UTF-8 encoded string containing the document to read.
+       * \param root [out] Contains the root value of the document if it was
+       *             successfully parsed.
+       * \param collectComments \c true to collect comment and allow writing them back during
+       *                        serialization, \c false to discard comments.
+       * \return \c true if the document was successfully parsed, \c false if an error occurred.
+       */
+      bool parse( const char *beginDoc, const char *endDoc, 
+                  Value &root,
+                  bool collectComments = true );
+
+      /** \brief Read a Value from a <a HREF="http://www.json.org">JSON</a> document into an arena.
+       * \param document UTF-8 encoded string containing the document to read.
+       * \param arena [out] The root() of the arena contains the root value of the
+       *              document if it was successfully parsed. The previous contents
+       *              of the arena are released first, and all memory of the new
+       *              values is taken from the arena.
+       * \param collectComments \c true to collect comment and allow writing them back during
+       *                        serialization, \c false to discard comments.
+       * \return \c true if the document was successfully parsed, \c false if an error occurred.
+       */
+      bool parse( const char *beginDoc, const char *endDoc, 
+                  ValueArena &arena,
+                  bool collectComments = true );
+
+      /** \brief Read a <a HREF="http://www.json.org">JSON</a> document as a stream of events.
+       * \param beginDoc Start of the UTF-8 encoded document to read.
+       * \param endDoc End of the document.
+       * \param handler Receives the values of the document in document order.
+       *                Comments are skipped.
+       * \return \c true if the document was successfully parsed, \c false if an error
+       *         occurred or the handler aborted parsing.
+       */
+      bool parse( const char *beginDoc, const char *endDoc, 
+                  ReaderHandler &handler );
 /*
       /// \brief Parse from input stream.
       /// \see Json::operator>>(std::istream&, Json::Value&).
@@ -54,6 +156,20 @@ namespace Json {
                   Value &root,
                   bool collectComments = true );
 */
+      /** \brief Parse strings following a tag as embedded documents.
+       *
+       * When an array at nesting level \c depth of the document contains a
+       * string equal to \c tag, the string value following it in the same
+       * array is unescaped and parsed as a JSON document in the same pass.
+       * The resulting value replaces the string. The tag is not looked for
+       * in arrays at other levels or inside embedded documents.
+       * \param tag Tag marking embedded documents, or an empty string to
+       *            disable embedded document parsing.
+       * \param depth Nesting level of the arrays holding the tag; the
+       *              outermost array of the document is level 1.
+       */
+      void setEmbeddedDocumentTag( const std::wstring &tag, int depth );
+
       /** \brief Returns a user friendly string that list errors in the parsed document.
        * \return Formatted error message with the list of errors with their location in 
        *         the parsed document. An empty string is returned if no error occurred
@@ -61,8 +177,8 @@ namespace Json {
        */
       std::wstring getFormatedErrorMessages() const;
 
-      /** \brief Get the amount of characters parsed from the input stream
-       * \return \c number of characters read from the input stream
+      /** \brief Get the amount of bytes parsed from the input stream
+       * \return \c number of bytes read from the input stream
        */
       size_t parsedInput() { return ( lastValueEnd_ == NULL ? current_ : lastValueEnd_ ) - begin_; }
 
@@ -116,14 +232,18 @@ namespace Json {
       bool readValue();
       bool readObject( Token &token );
       bool readArray( Token &token );
+      bool readEmbeddedDocument();
       bool decodeNumber( Token &token );
-      bool decodeString( Token &token );
+      bool decodeString( Token &token, bool &isTag );
       bool decodeString( Token &token, std::wstring &decoded );
+      bool unescapeString( Token &token, std::string &decoded );
       bool decodeDouble( Token &token );
       bool decodeUnicodeEscapeSequence( Token &token, 
                                         Location &current, 
                                         Location end, 
-					std::wstring &decoded );
+					unsigned int &unicode );
+      bool checkHandler( bool handled, 
+                         Token &token );
       bool addError( const std::wstring &message, 
                      Token &token,
                      Location extra = 0 );
@@ -146,7 +266,7 @@ namespace Json {
       typedef std::stack<Value *> Nodes;
       Nodes nodes_;
       Errors errors_;
-      std::wstring document_;
+      std::string document_;
       Location begin_;
       Location end_;
       Location current_;
@@ -154,6 +274,14 @@ namespace Json {
       Value *lastValue_;
       std::wstring commentsBefore_;
       bool collectComments_;
+      std::wstring embeddedTag_;
+      int embeddedTagDepth_;
+      std::deque<std::string> embedded_;
+      size_t embeddedDepth_;
+      int arrayDepth_;
+      ReaderHandler *handler_;
+      std::wstring string_;
+      bool lastValueIsTag_;
    };
 
    /** \brief Read from 'sin' into 'root'.
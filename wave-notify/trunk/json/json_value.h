@@ -4,8 +4,12 @@
 # include "json_forwards.h"
 # include <string>
 # include <vector>
+# include <cstddef>
+# include <new>
 
-# ifndef JSON_USE_CPPTL_SMALLMAP
+# if defined(JSON_USE_FLAT_MAP)
+#  include "json_flatmap.h"
+# elif !defined(JSON_USE_CPPTL_SMALLMAP)
 #  include <map>
 # else
 #  include <cpptl/smallmap.h>
@@ -81,6 +85,95 @@ namespace Json {
       const wchar_t *str_;
    };
 
+   /** \brief Allocates storage for the containers of Value.
+    *
+    * Storage is taken from the current ValueAllocator. Releasing storage
+    * returns it to the allocator it was taken from.
+    */
+   JSON_API void *allocateValueStorage( size_t size );
+   JSON_API void releaseValueStorage( void *storage );
+
+   /** \brief STL allocator that takes its storage from allocateValueStorage().
+    */
+   template<typename T>
+   class ValueStorageAllocator
+   {
+   public:
+      typedef T value_type;
+      typedef T *pointer;
+      typedef const T *const_pointer;
+      typedef T &reference;
+      typedef const T &const_reference;
+      typedef size_t size_type;
+      typedef ptrdiff_t difference_type;
+
+      template<typename U>
+      struct rebind
+      {
+         typedef ValueStorageAllocator<U> other;
+      };
+
+      ValueStorageAllocator()
+      {
+      }
+
+      ValueStorageAllocator( const ValueStorageAllocator & )
+      {
+      }
+
+      template<typename U>
+      ValueStorageAllocator( const ValueStorageAllocator<U> & )
+      {
+      }
+
+      pointer address( reference value ) const
+      {
+         return &value;
+      }
+
+      const_pointer address( const_reference value ) const
+      {
+         return &value;
+      }
+
+      pointer allocate( size_type count, const void * = 0 )
+      {
+         return static_cast<pointer>( allocateValueStorage( count * sizeof(T) ) );
+      }
+
+      void deallocate( pointer storage, size_type )
+      {
+         releaseValueStorage( storage );
+      }
+
+      size_type max_size() const
+      {
+         return size_type(-1) / sizeof(T);
+      }
+
+      void construct( pointer storage, const T &value )
+      {
+         new( static_cast<void *>( storage ) ) T( value );
+      }
+
+      void destroy( pointer storage )
+      {
+         storage->~T();
+      }
+   };
+
+   template<typename T, typename U>
+   inline bool operator ==( const ValueStorageAllocator<T> &, const ValueStorageAllocator<U> & )
+   {
+      return true;
+   }
+
+   template<typename T, typename U>
+   inline bool operator !=( const ValueStorageAllocator<T> &, const ValueStorageAllocator<U> & )
+   {
+      return false;
+   }
+
    /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
     *
     * This class is a discriminated union wrapper that can represents a:
@@ -157,11 +250,14 @@ namespace Json {
       };
 
    public:
-#  ifndef JSON_USE_CPPTL_SMALLMAP
-      typedef std::map<CZString, Value> ObjectValues;
+#  if defined(JSON_USE_FLAT_MAP)
+      typedef ValueFlatMap<CZString, Value> ObjectValues;
+#  elif !defined(JSON_USE_CPPTL_SMALLMAP)
+      typedef std::map<CZString, Value, std::less<CZString>, 
+                       ValueStorageAllocator<std::pair<const CZString, Value> > > ObjectValues;
 #  else
       typedef CppTL::SmallMap<CZString, Value> ObjectValues;
-#  endif // ifndef JSON_USE_CPPTL_SMALLMAP
+#  endif // if defined(JSON_USE_FLAT_MAP)
 # endif // ifndef JSON_VALUE_USE_INTERNAL_MAP
 #endif // ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
 
@@ -532,6 +628,72 @@ namespace Json {
       virtual wchar_t *duplicateStringValue( const wchar_t *value, 
                                           unsigned int length = unknown ) = 0;
       virtual void releaseStringValue( wchar_t *value ) = 0;
+      virtual void *allocateStorage( size_t size ) = 0;
+      virtual void releaseStorage( void *storage ) = 0;
+   };
+
+   /** \brief ValueAllocator that takes the memory of a Value tree from large pages.
+    *
+    * Memory is only taken from the arena while a ValueArena::Scope for it is
+    * active on the calling thread; Reader::parse() sets one up when it is
+    * given an arena. An arena must only be used by one thread at a time. Releasing
+    * memory of the arena does nothing; every block is marked as the arena's, so
+    * this is decided without looking at the arena. All of it is returned at once
+    * by clear() or when the arena is destroyed, and the pages are reused by the
+    * next parse.
+    *
+    * Values of root() must not be swapped with values outside of the arena,
+    * because they would keep pointing into the pages of the arena.
+    */
+   class JSON_API ValueArena : public ValueAllocator
+   {
+   public:
+      /** \brief Makes an arena the current ValueAllocator of the calling thread until it goes out of scope.
+       */
+      class JSON_API Scope
+      {
+      public:
+         Scope( ValueArena *arena );
+         ~Scope();
+
+      private:
+         Scope( const Scope & );
+         void operator =( const Scope & );
+
+         ValueAllocator *previous_;
+      };
+
+      ValueArena( unsigned int pageSize = 16384 );
+      virtual ~ValueArena();
+
+      Value &root();
+      void clear();
+
+      virtual wchar_t *makeMemberName( const wchar_t *memberName );
+      virtual void releaseMemberName( wchar_t *memberName );
+      virtual wchar_t *duplicateStringValue( const wchar_t *value, 
+                                          unsigned int length = unknown );
+      virtual void releaseStringValue( wchar_t *value );
+      virtual void *allocateStorage( size_t size );
+      virtual void releaseStorage( void *storage );
+
+   private:
+      struct Page
+      {
+         Page *next_;
+         size_t size_;
+         size_t used_;
+      };
+
+      ValueArena( const ValueArena & );
+      void operator =( const ValueArena & );
+
+      void releasePages( Page *pages, bool keep );
+
+      Page *pages_;
+      Page *spare_;
+      unsigned int pageSize_;
+      Value root_;
    };
 
 #ifdef JSON_VALUE_USE_INTERNAL_MAP
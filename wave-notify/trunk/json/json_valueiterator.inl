@@ -11,6 +11,9 @@
 // //////////////////////////////////////////////////////////////////
 
 ValueIteratorBase::ValueIteratorBase()
+#ifndef JSON_VALUE_USE_INTERNAL_MAP
+   : current_()
+#endif
 {
 }
 
@@ -78,7 +81,7 @@ ValueIteratorBase::difference_type
 ValueIteratorBase::computeDistance( const SelfType &other ) const
 {
 #ifndef JSON_VALUE_USE_INTERNAL_MAP
-# ifdef JSON_USE_CPPTL_SMALLMAP
+# if defined(JSON_USE_CPPTL_SMALLMAP) || defined(JSON_USE_FLAT_MAP)
    return current_ - other.current_;
 # else
    return difference_type( std::distance( current_, other.current_ ) );
@@ -50,6 +50,8 @@ private:
 	wstring m_szRequestingAvatar;
 	BOOL m_fClientSuspended;
 	BOOL m_fClientLocked;
+	ULONGLONG m_uResponseTicks;
+	CWaveTraceReplay * m_lpReplay;
 
 public:
 	CAppWindow();
@@ -57,7 +59,7 @@ public:
 
 	CNotifyIcon * GetNotifyIcon() const { return m_lpNotifyIcon; }
 	void HaveReportedWave(wstring szWaveID);
-	CWaveContact * GetWaveContact(wstring szEmailAddress);
+	CWaveContact * GetWaveContact(const wstring & szEmailAddress);
 	void DisplayHelp();
 	void QueueRequest(CCurl * lpRequest);
 	void CancelRequest(CCurl * lpRequest);
@@ -91,8 +93,8 @@ private:
 	void ProcessResponse(CWaveResponse * lpResponse);
 	void ProcessReconnecting();
 	void ProcessConnected();
-	void SynchronisePopups(CUnreadWaveCollection * lpUnreads, BOOL fManual);
-	void TruncateLastReported();
+	void SynchronisePopups(CUnreadWaveCollection * lpUnreads, BOOL fManual, const TStringBoolMap * lpChanges);
+	void TruncateLastReported(const TStringBoolMap * lpChanges);
 	void DisplayWavePopups(BOOL fManual);
 	void CheckWavesNow();
 	void UpdateWorkingIcon();
@@ -101,6 +103,7 @@ private:
 	void ProcessUnreadWavesNotifyIcon(INT nUnreadWaves);
 	void ProcessLoggedOn();
 	void ProcessSignedOut();
+	void ReportStatistics();
 	void StartWorking();
 	void StopWorking();
 	BOOL AllowContextMenu();
@@ -110,7 +113,6 @@ private:
 	void ClientConnected(CONNECT_REASON nReason);
 	void ClientDisconnected(CONNECT_REASON nReason);
 	void ReportContactOnline(CWaveContact * lpContact, BOOL fOnline);
-	LRESULT ProcessCurlDataReceived(LPCURL_DATA_RECEIVED lpParam);
 	LRESULT ProcessCurlCompleted(CCurl * lpCurl);
 	void SignalContactUpdated(CWaveContact * lpContact);
 
@@ -137,6 +139,7 @@ private:
 	BOOL m_fPlaySoundOnNewWave;
 	wstring m_szBrowser;
 	BOOL m_fNotificationWhenOnline;
+	DWORD m_dwMessageTextBudget;
 	BOOL m_fConnected;
 	CAvatar * m_lpGenericAvatar;
 	BOOL m_fEnableExperimental;
@@ -165,7 +168,7 @@ public:
 		return m_lpWindow;
 	}
 	BOOL Initialise();
-	CWaveContact * GetWaveContact(wstring szEmailAddress) const {
+	CWaveContact * GetWaveContact(const wstring & szEmailAddress) const {
 		return GetAppWindow()->GetWaveContact(szEmailAddress);
 	}
 	void SetStartWithWindows(BOOL fValue);
@@ -173,6 +176,7 @@ public:
 	BOOL GetPlaySoundOnNewWave() const { return m_fPlaySoundOnNewWave; }
 	void SetNotificationWhenOnline(BOOL fValue) { m_fNotificationWhenOnline = fValue; }
 	BOOL GetNotificationWhenOnline() const { return m_fNotificationWhenOnline; }
+	DWORD GetMessageTextBudget() const { return m_dwMessageTextBudget; }
 	wstring GetBrowser() const { return m_szBrowser; }
 	void SetBrowser(wstring szBrowser) {
 		m_szBrowser = szBrowser;
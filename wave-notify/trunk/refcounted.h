@@ -21,18 +21,19 @@
 class CRefCounted
 {
 private:
-	INT m_nRef;
+	volatile LONG m_lRef;
 
 public:
-	CRefCounted() : m_nRef(1) { }
+	CRefCounted() : m_lRef(1) { }
 	virtual ~CRefCounted() {
-		ASSERT(m_nRef == 0);
+		ASSERT(m_lRef == 0);
 	}
 
-	void AddRef() { m_nRef++; }
+	void AddRef() { InterlockedIncrement(&m_lRef); }
+	LONG GetRefCount() const { return m_lRef; }
 	void Release() {
-		ASSERT(m_nRef > 0);
-		if (--m_nRef == 0)
+		ASSERT(m_lRef > 0);
+		if (InterlockedDecrement(&m_lRef) == 0)
 			delete this;
 	}
 };
@@ -63,6 +63,8 @@ private:
 	static const wstring RegBrowser;
 	static const wstring RegNotificationWhenOnline;
 	static const wstring RegApplicationRunning;
+	static const wstring RegMessageTextBudget;
+	static const wstring RegSessionState;
 
 	CRegKey * m_lpKey;
 
@@ -97,6 +99,8 @@ public:
 	SETTINGS_VALUE(wstring, Browser);
 	SETTINGS_VALUE(BOOL, NotificationWhenOnline);
 	SETTINGS_VALUE(BOOL, ApplicationRunning);
+	SETTINGS_VALUE(DWORD, MessageTextBudget);
+	SETTINGS_ENCRYPTED_VALUE(wstring, SessionState);
 
 	BOOL GetValue(wstring szName, wstring & szValue) const {
 		ASSERT(!szName.empty());
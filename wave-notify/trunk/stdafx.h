@@ -60,9 +60,11 @@
 #include <string>
 #include <list>
 #include <map>
+#include <set>
 #include <sstream>
 #include <iomanip>
 #include <queue>
+#include <algorithm>
 
 using namespace std;
 
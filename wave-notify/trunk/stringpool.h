@@ -0,0 +1,46 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _INC_STRINGPOOL
+#define _INC_STRINGPOOL
+
+#pragma once
+
+typedef const wstring * LPCINTERNED;
+
+typedef vector<LPCINTERNED> TInternedVector;
+typedef TInternedVector::iterator TInternedVectorIter;
+typedef TInternedVector::const_iterator TInternedVectorConstIter;
+typedef map<wstring, UINT> TInternedMap;
+typedef TInternedMap::iterator TInternedMapIter;
+typedef TInternedMap::const_iterator TInternedMapConstIter;
+
+class CStringPool
+{
+private:
+	static CLock m_vLock;
+	static TInternedMap m_vStrings;
+	static const wstring m_szEmpty;
+
+public:
+	static LPCINTERNED Intern(const wstring & szString);
+	static void Release(LPCINTERNED lpString);
+	static LPCINTERNED GetEmpty() { return &m_szEmpty; }
+	static UINT GetCount();
+};
+
+#endif // _INC_STRINGPOOL
@@ -35,6 +35,9 @@ typedef TRectVector::const_iterator TRectVectorConstIter;
 typedef vector<HWND> THwndVector;
 typedef THwndVector::iterator THwndVectorIter;
 typedef THwndVector::const_iterator THwndVectorConstIter;
+typedef set<wstring> TStringSet;
+typedef TStringSet::iterator TStringSetIter;
+typedef TStringSet::const_iterator TStringSetConstIter;
 typedef map<wstring, BOOL> TStringBoolMap;
 typedef TStringBoolMap::iterator TStringBoolMapIter;
 typedef TStringBoolMap::const_iterator TStringBoolMapConstIter;
@@ -40,24 +40,23 @@ typedef TUnreadWaveVector::const_iterator TUnreadWaveVectorConstIter;
 class CUnreadWave
 {
 private:
-	wstring m_szId;
-	wstring m_szContact;
-	CWaveContact * m_lpContact;
-	wstring m_szSubject;
+	CWave * m_lpWave;
+	CWaveMessage * m_lpMessage;
 	wstring m_szBody;
-	CDateTime m_dtTime;
-	UINT m_uUnread;
+	CWaveContact * m_lpContact;
 
 public:
 	CUnreadWave(CWave * lpWave, CWaveMessage * lpMessage);
-	virtual ~CUnreadWave() { }
-
-	wstring GetID() const { return m_szId; }
-	wstring GetContact() const { return m_szContact; }
-	wstring GetSubject() const { return m_szSubject; }
-	wstring GetBody() const { return m_szBody; }
-	CDateTime GetTime() const { return m_dtTime; }
-	UINT GetUnread() const { return m_uUnread; }
+	virtual ~CUnreadWave() {
+		m_lpWave->Release();
+	}
+
+	const wstring & GetID() const { return m_lpWave->GetID(); }
+	const wstring & GetContact() const { return m_lpMessage->GetEmailAddress(); }
+	const wstring & GetSubject() const { return m_lpWave->GetSubject(); }
+	const wstring & GetBody() const { return m_szBody; }
+	CDateTime GetTime() const { return m_lpWave->GetTime(); }
+	UINT GetUnread() const { return m_lpWave->GetUnreadMessages(); }
 	CWaveContact * GetWaveContact() const { return m_lpContact; }
 	void SetWaveContact(CWaveContact * lpContact) { m_lpContact = lpContact; }
 
@@ -70,9 +69,10 @@ class CUnreadWaveCollection
 private:
 	TUnreadWaveMap m_vUnreadsMap;
 	TUnreadWaveVector m_vUnreadsVector;
+	LPCINTERNED m_lpSelf;
 
 private:
-	CUnreadWaveCollection(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent);
+	CUnreadWaveCollection(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent, const TStringBoolMap * lpChanges);
 
 public:
 	virtual ~CUnreadWaveCollection();
@@ -96,13 +96,14 @@ public:
 		m_vUnreadsVector.clear();
 	}
 
-	static CUnreadWaveCollection * CreateUnreadWaves(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent) {
-		return new CUnreadWaveCollection(lpLastReported, lpCurrent);
+	static CUnreadWaveCollection * CreateUnreadWaves(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent, const TStringBoolMap * lpChanges = NULL) {
+		return new CUnreadWaveCollection(lpLastReported, lpCurrent, lpChanges);
 	}
 
 private:
 	void InsertAllWaves(CWaveCollection * lpCurrent);
-	void InsertChangesOnly(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent);
+	void InsertChangesOnly(CWaveCollection * lpLastReported, CWaveCollection * lpCurrent, const TStringBoolMap * lpChanges);
+	void InsertChange(CWaveCollection * lpLastReported, CWave * lpWave);
 	void Insert(CUnreadWave * lpUnread);
 	CUnreadWave * GetDifference(CWave * lpReportedWave, CWave * lpNewWave) const;
 	BOOL WavesEqual(CWave * lpReportedWave, CWave * lpNewWave) const;
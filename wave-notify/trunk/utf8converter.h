@@ -51,6 +51,8 @@ public:
 	wstring Parse(TByteVector & vData);
 	wstring Parse(LPBYTE lpBytes, size_t cbBytes);
 
+	static INT GetTrailingBytes(BYTE cLead) { return m_vTrailingBytes[cLead]; }
+
 private:
 	void Reset();
 	void DoNextChar(utf8_t cSource, TUTF16Vector & vResult);
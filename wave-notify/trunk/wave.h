@@ -24,20 +24,67 @@
 
 #define RECONNECT_DELAY	5000
 
-#define WAVE_URL_CLIENTLOGIN 		L"https://www.google.com/accounts/ClientLogin"
-#define WAVE_URL_AUTH 			L"https://wave.google.com/wave/?nouacheck&auth=%s"
-#define WAVE_URL_LOGOUT 		L"https://wave.google.com/wave/logout"
-#define WAVE_URL_WAVES 			L"https://wave.google.com/wave/?nouacheck"
-#define WAVE_URL_INBOX 			L"https://wave.google.com/wave/?auth=%s"
-#define WAVE_URL_WAVE			L"https://wave.google.com/wave/?auth=%s#restored:wave:%s.1"
-#define WAVE_URL_SESSIONID		L"https://wave.google.com/wave/wfe/channel?VER=6&RID=%d&CVER=3&zx=%s&t=1"
-#define WAVE_URL_CHANNEL		L"https://wave.google.com/wave/wfe/channel?VER=6&RID=rpc&SID=%s&CI=0&AID=%d&TYPE=xmlhttp&zx=%s&t=1"
-#define WAVE_URL_CHANNEL_POST		L"https://wave.google.com/wave/wfe/channel?VER=6&SID=%s&RID=%d&zx=%s&t=1"
-#define WAVE_URL_AVATAR_PRIVATE_PREFIX	L"https://wave.google.com/wave/c"
+// The number of attempts of a reconnect tier before the next tier is tried.
+
+#define RECONNECT_CHANNEL_ATTEMPTS	2
+#define RECONNECT_SID_ATTEMPTS		3
+
+#if defined(_DEBUG) && defined(TEST_LOCAL_WAVE)
+#define WAVE_URL_ACCOUNTS_HOST		L"http://localhost:8080"
+#define WAVE_URL_WAVE_HOST		L"http://localhost:8080"
+#else
+#define WAVE_URL_ACCOUNTS_HOST		L"https://www.google.com"
+#define WAVE_URL_WAVE_HOST		L"https://wave.google.com"
+#endif
+
+#define WAVE_URL_CLIENTLOGIN 		WAVE_URL_ACCOUNTS_HOST L"/accounts/ClientLogin"
+#define WAVE_URL_AUTH 			WAVE_URL_WAVE_HOST L"/wave/?nouacheck&auth=%s"
+#define WAVE_URL_LOGOUT 		WAVE_URL_WAVE_HOST L"/wave/logout"
+#define WAVE_URL_WAVES 			WAVE_URL_WAVE_HOST L"/wave/?nouacheck"
+#define WAVE_URL_INBOX 			WAVE_URL_WAVE_HOST L"/wave/?auth=%s"
+#define WAVE_URL_WAVE			WAVE_URL_WAVE_HOST L"/wave/?auth=%s#restored:wave:%s.1"
+#define WAVE_URL_SESSIONID		WAVE_URL_WAVE_HOST L"/wave/wfe/channel?VER=6&RID=%d&CVER=3&zx=%s&t=1"
+#define WAVE_URL_CHANNEL		WAVE_URL_WAVE_HOST L"/wave/wfe/channel?VER=6&RID=rpc&SID=%s&CI=0&AID=%d&TYPE=xmlhttp&zx=%s&t=1"
+#define WAVE_URL_CHANNEL_POST		WAVE_URL_WAVE_HOST L"/wave/wfe/channel?VER=6&SID=%s&RID=%d&zx=%s&t=1"
+#define WAVE_URL_AVATAR_PRIVATE_PREFIX	WAVE_URL_WAVE_HOST L"/wave/c"
 #define WAVE_URL_AVATAR_PUBLIC_PREFIX	L"https://www.google.com/s2"
 
+#define WAVE_CHANNEL_TRACE		L"channel-trace.bin"
+
 #define WAVE_HASH_POOL			L"abcdefghijklmnopqrstuvwxyz0123456789"
 
+// The number of channel posts that may be in flight at the same time, and
+// the number of times a post that failed on the network is sent again.
+
+#define WAVE_POST_WINDOW		3
+#define WAVE_POST_RETRIES		2
+
+// Requests are added to a post until its body reaches this size (in
+// characters); the rest waits for the next post. A single contact details
+// request asks for at most this many contacts.
+
+#define WAVE_POST_MAX_SIZE		(64 * 1024)
+#define WAVE_CONTACT_DETAILS_MAX	100
+
+#define WAVE_FINGERPRINT_BASIS		0xcbf29ce484222325ui64
+#define WAVE_FINGERPRINT_PRIME		0x00000100000001b3ui64
+
+// The initial number of slots of the contact index; it doubles whenever
+// it would become more than half full.
+
+#define WAVE_CONTACT_INDEX_MIN		64
+
+// Messages keep at most this many characters of their text, which is more
+// than a popup can show. Messages of waves without unread messages are
+// never shown and keep no text at all.
+
+#define WAVE_MESSAGE_MAX_TEXT		1024
+
+// The view holds at most this many characters of message text over all its
+// waves, unless the MessageTextBudget registry setting says otherwise.
+
+#define WAVE_MESSAGE_TEXT_BUDGET	(256 * 1024)
+
 class CWave;
 class CWaveName;
 class CWaveContact;
@@ -48,6 +95,8 @@ class CWaveListener;
 class CWaveResponseStartListening;
 class CWaveContactStatus;
 class CWaveContactStatusCollection;
+class CWaveDecoder;
+class CWaveTraceReplay;
 
 typedef vector<CWaveMessage *> TWaveMessageVector;
 typedef TWaveMessageVector::iterator TWaveMessageVectorIter;
@@ -58,9 +107,7 @@ typedef TWaveVector::const_iterator TWaveVectorConstIter;
 typedef vector<CWaveContact *> TWaveContactVector;
 typedef TWaveContactVector::iterator TWaveContactVectorIter;
 typedef TWaveContactVector::const_iterator TWaveContactVectorConstIter;
-typedef map<wstring, CWaveContact *> TWaveContactMap;
-typedef TWaveContactMap::iterator TWaveContactMapIter;
-typedef TWaveContactMap::const_iterator TWaveContactMapConstIter;
+typedef queue<CWaveContact *> TWaveContactQueue;
 typedef vector<CWaveName *> TWaveNameVector;
 typedef TWaveNameVector::iterator TWaveNameVectorIter;
 typedef TWaveNameVector::const_iterator TWaveNameVectorConstIter;
@@ -73,10 +120,27 @@ typedef TWaveMap::const_iterator TWaveMapConstIter;
 typedef vector<CWaveRequest *> TWaveRequestVector;
 typedef TWaveRequestVector::iterator TWaveRequestVectorIter;
 typedef TWaveRequestVector::const_iterator TWaveRequestVectorConstIter;
+typedef vector<ULONGLONG> TFingerprintVector;
+typedef TFingerprintVector::iterator TFingerprintVectorIter;
+typedef TFingerprintVector::const_iterator TFingerprintVectorConstIter;
 typedef map<wstring, CWaveContactStatus *> TWaveContactStatusMap;
 typedef TWaveContactStatusMap::iterator TWaveContactStatusMapIter;
 typedef TWaveContactStatusMap::const_iterator TWaveContactStatusMapConstIter;
 
+typedef struct tagWAVE_POST
+{
+	CCurl * lpRequest;
+	wstring szSID;
+	INT nRID;
+	wstring szPostData;
+	INT nRetries;
+	TStringVector vStartedListeners;
+} WAVE_POST, * LPWAVE_POST;
+
+typedef vector<WAVE_POST> TWavePostVector;
+typedef TWavePostVector::iterator TWavePostVectorIter;
+typedef TWavePostVector::const_iterator TWavePostVectorConstIter;
+
 typedef enum
 {
 	WCS_BEGIN_LOGON,
@@ -122,6 +186,14 @@ typedef enum
 	WSR_MAX
 } WAVE_SESSION_REQUESTING;
 
+typedef enum
+{
+	WRT_CHANNEL,
+	WRT_SID,
+	WRT_LOGIN,
+	WRT_MAX
+} WAVE_RECONNECT_TIER;
+
 typedef enum
 {
 	WSS_OFFLINE,
@@ -148,7 +220,8 @@ private:
 	WAVE_SESSION_REQUESTING m_nRequesting;
 	CCurl * m_lpRequest;
 	CCurl * m_lpChannelRequest;
-	CCurl * m_lpPostRequest;
+	TWavePostVector m_vPosts;
+	CLock m_vChannelLock;
 	wstring m_szSID;
 	INT m_nAID;
 	INT m_nRID;
@@ -157,16 +230,28 @@ private:
 	INT m_nNextListenerID;
 	WAVE_SESSION_STATE m_nState;
 	CTimer * m_lpReconnectTimer;
+	WAVE_RECONNECT_TIER m_nReconnectTier;
+	INT m_nReconnectAttempts;
+	DWORD m_dwReconnectStarted;
+	WAVE_RECONNECT_TIER m_nLastReconnectTier;
+	DWORD m_dwLastReconnectTime;
+	DWORD m_dwLoginStarted;
+	DWORD m_dwConnectTime;
+	volatile LONG m_lChannelBytes;
 	INT m_nFlushSuspended;
+	BOOL m_fResumingSession;
 	TWaveRequestVector m_vRequestQueue;
+	UINT m_uMaxQueuedRequests;
 	TCurlVector m_vOwnedRequests;
+	Json::Reader m_vChannelReader;
+	CWaveDecoder * m_lpChannelDecoder;
 
 public:
 	CWaveSession(CWindowHandle * lpTargetWindow);
 	virtual ~CWaveSession();
 	BOOL Login(wstring szUsername, wstring szPassword);
 	BOOL Reconnect();
-	void SignOut();
+	void SignOut(BOOL fKeepSession = FALSE);
 	wstring GetInboxUrl() const;
 	wstring GetWaveUrl(wstring szWaveId) const;
 	wstring GetEmailAddress() const { return m_szEmailAddress; }
@@ -181,15 +266,25 @@ public:
 	void AddProgressTarget(CWindowHandle * lpSignalWindow);
 	void RemoveProgressTarget(CWindowHandle * lpSignalWindow);
 	BOOL ProcessCurlResponse(CCurl * lpCurl);
-	BOOL ParseChannelResponse(wstring szResponse);
+	BOOL ParseChannelResponse(LPCSTR szBegin, LPCSTR szEnd);
+	BOOL ReplayChannelResponse(Json::Reader & vReader, CWaveDecoder & vDecoder, LPCSTR szBegin, LPCSTR szEnd);
 	WAVE_SESSION_STATE GetState() const { return m_nState; }
 	void StopReconnecting();
 	void QueueRequest(CWaveRequest * lpRequest);
 	void FlushRequestQueue();
 	void SuspendRequestFlush();
 	void ReleaseRequestFlush();
+	UINT GetQueuedRequests() const { return m_vRequestQueue.size(); }
+	UINT GetMaxQueuedRequests() const { return m_uMaxQueuedRequests; }
 	void ForceReconnect();
 	wstring GetAuthKey() const { return m_szAuthKey; }
+	WAVE_RECONNECT_TIER GetLastReconnectTier() const { return m_nLastReconnectTier; }
+	DWORD GetLastReconnectTime() const { return m_dwLastReconnectTime; }
+	DWORD GetConnectTime() const { return m_dwConnectTime; }
+	DWORD GetChannelBytes() const { return (DWORD)m_lChannelBytes; }
+	const CWaveDecoder * GetChannelDecoder() const { return m_lpChannelDecoder; }
+
+	static void InitialiseChannelReader(Json::Reader & vReader);
 
 private:
 	void ReportReceived(CWaveResponse * lpResponse) {
@@ -204,7 +299,7 @@ private:
 	void ProcessAuthKeyResponse();
 	void ProcessCookieResponse();
 	void ProcessSessionDetailsResponse();
-	void ProcessPostResponse();
+	void ProcessPostResponse(CCurl * lpCurl);
 	void SignalProgress(WAVE_CONNECTION_STATE nStatus);
 	void InitiateReconnect();
 	void PostChannelRequest();
@@ -213,14 +308,22 @@ private:
 	void ProcessSIDResponse();
 	void PostSIDRequest();
 	wstring BuildHash();
-	CWaveResponse * ParseWfeResponse(wstring szResponse, BOOL & fSuccess);
 	wstring SerializeRequest(CWaveRequest * lpRequest);
 	void PostSignOutRequest();
 	void ProcessSignOutResponse();
 	void ReconnectTimer();
 	void NextReconnect();
-	wstring ExtractChannelResponse(wstring szResponse);
+	void ScheduleReconnect();
+	void ReconnectCompleted();
+	BOOL ExtractChannelResponse(const TByteVector & vResponse, LPCSTR & szBegin, LPCSTR & szEnd);
+	BOOL DecodeChannelResponse(Json::Reader & vReader, CWaveDecoder & vDecoder, LPCSTR szBegin, LPCSTR szEnd, BOOL fReplay);
 	void PostRequests();
+	BOOL SaveSessionState();
+	BOOL RestoreSessionState();
+	void DeleteSessionState();
+	void CoalesceRequests();
+	void SendPost(WAVE_POST & vPost);
+	BOOL IsRequestBlocked(CWaveRequest * lpRequest) const;
 
 	static VOID CALLBACK ReconnectTimerCallback(HWND hWnd, UINT uMsg, UINT_PTR nEventId, DWORD dwTime);
 };
@@ -229,6 +332,7 @@ class CWaveContact
 {
 private:
 	wstring m_szEmailAddress;
+	wstring m_szKey;
 	wstring m_szName;
 	wstring m_szDisplayName;
 	wstring m_szAvatarUrl;
@@ -247,7 +351,8 @@ public:
 
 	static CWaveContact * CreateFromJson(Json::Value & vRoot);
 
-	wstring GetEmailAddress() const { return m_szEmailAddress; }
+	const wstring & GetEmailAddress() const { return m_szEmailAddress; }
+	const wstring & GetKey() const { return m_szKey; }
 	wstring GetName() const { return m_szName; }
 	const TWaveNameVector & GetNames() const { return m_vNames; }
 	wstring GetDisplayName() const { return m_szDisplayName; }
@@ -264,12 +369,19 @@ public:
 	wstring GetAbsoluteAvatarUrl() const;
 	void Merge(CWaveContactStatus * lpStatus);
 	void Merge(CWaveContact * lpContact);
+
+private:
+	void Complete();
+
+	friend class CWaveDecoder;
 };
 
 class CWaveContactCollection
 {
 private:
-	TWaveContactMap m_vContacts;
+	TWaveContactVector m_vContacts;
+	TWaveContactVector m_vIndex;
+	TWaveContactQueue m_vNeedsAvatar;
 
 public:
 	CWaveContactCollection() { }
@@ -277,15 +389,20 @@ public:
 
 	static CWaveContactCollection * CreateFromJson(Json::Value & vRoot);
 
-	const TWaveContactMap & GetContacts() const { return m_vContacts; }
-	CWaveContact * GetContact(wstring szEmailAddress) const {
-		CHECK_NOT_EMPTY(szEmailAddress);
-
-		TWaveContactMapConstIter pos = m_vContacts.find(szEmailAddress);
-		return pos == m_vContacts.end() ? NULL : pos->second;
-	}
+	const TWaveContactVector & GetContacts() const { return m_vContacts; }
+	CWaveContact * GetContact(const wstring & szEmailAddress) const;
+	CWaveContact * GetNeedsAvatar();
 	void Merge(CWaveContactCollection * lpContacts);
 	void Merge(CWaveContactStatusCollection * lpStatuses);
+
+private:
+	BOOL AddContact(CWaveContact * lpContact);
+	UINT FindSlot(LPCWSTR szEmailAddress) const;
+	void GrowIndex();
+
+	static ULONGLONG HashEmailAddress(LPCWSTR szEmailAddress);
+
+	friend class CWaveDecoder;
 };
 
 class CWaveContactStatus
@@ -306,6 +423,9 @@ public:
 	wstring GetEmailAddress() const { return m_szEmailAddress; }
 	BOOL GetOnline() const { return m_fOnline; }
 	wstring GetStatusMessage() const { return m_szStatusMessage; }
+
+private:
+	friend class CWaveDecoder;
 };
 
 class CWaveContactStatusCollection
@@ -321,6 +441,9 @@ public:
 	static CWaveContactStatusCollection * CreateFromJson(Json::Value & vRoot);
 
 	const TWaveContactStatusMap & GetStatuses() const { return m_vStatuses; }
+
+private:
+	friend class CWaveDecoder;
 };
 
 typedef enum
@@ -346,45 +469,64 @@ public:
 
 	wstring GetName() const { return m_szName; }
 	WAVE_NAME_TYPE GetType() const { return m_nType; }
+
+private:
+	friend class CWaveDecoder;
 };
 
 class CWaveMessage
 {
 private:
 	wstring m_szText;
-	wstring m_szEmailAddress;
+	LPCINTERNED m_lpEmailAddress;
 	UINT m_uContactId;
 	UINT m_uOrder;
+	ULONGLONG m_uFingerprint;
+	UINT m_uLength;
+	BOOL m_fBlank;
 
 private:
 	CWaveMessage();
 
 public:
-	CWaveMessage(const CWaveMessage & _Other);
 	virtual ~CWaveMessage() { }
 
 	static CWaveMessage * CreateFromJson(Json::Value & vRoot, UINT uOrder);
 
 	void ResolveContact(CWave * lpWave);
 
-	wstring GetText() const { return m_szText; }
-	wstring GetEmailAddress() const { return m_szEmailAddress; }
+	const wstring & GetText() const { return m_szText; }
+	const wstring & GetEmailAddress() const { return *m_lpEmailAddress; }
+	LPCINTERNED GetInternedEmailAddress() const { return m_lpEmailAddress; }
 	UINT GetContactId() const { return m_uContactId; }
 	UINT GetOrder() const { return m_uOrder; }
+	ULONGLONG GetFingerprint() const { return m_uFingerprint; }
+	UINT GetLength() const { return m_uLength; }
+	BOOL IsBlank() const { return m_fBlank; }
 
 	bool operator ==(const CWaveMessage & _Other) const {
-		// Optimisation shortcut: only consider contactID's because these are unique
-		// inside a wave.
-		// return m_szText == _Other.m_szText && m_szEmailAddress == _Other.m_szEmailAddress;
+		// The text may have been truncated or discarded, so messages are
+		// compared on what is left of them.
 
-		return m_szText == _Other.m_szText && m_uContactId == _Other.m_uContactId;
+		return
+			m_uFingerprint == _Other.m_uFingerprint &&
+			m_uContactId == _Other.m_uContactId &&
+			m_uLength == _Other.m_uLength;
 	}
 	bool operator !=(const CWaveMessage & _Other) const {
 		return !(*this == _Other);
 	}
+
+private:
+	void Complete();
+	void UpdateFingerprint();
+	void DiscardText() { wstring().swap(m_szText); }
+
+	friend class CWave;
+	friend class CWaveDecoder;
 };
 
-class CWave
+class CWave : public CRefCounted
 {
 private:
 	wstring m_szID;
@@ -392,26 +534,33 @@ private:
 	UINT m_uUnreadMessages;
 	wstring m_szSubject;
 	TWaveMessageVector m_vMessages;
-	TStringVector m_vContacts;
+	TInternedVector m_vContacts;
 	wstring m_szEmailAddress;
 	CDateTime m_dtTime;
+	TFingerprintVector m_vFingerprints;
+	UINT m_uTextLength;
 
 private:
 	CWave();
 public:
-	CWave(const CWave & _Other);
 	virtual ~CWave();
 
 	static CWave * CreateFromJson(Json::Value & vRoot);
 
-	wstring GetID() const { return m_szID; }
+	const wstring & GetID() const { return m_szID; }
 	UINT GetTotalMessages() const { return m_uMessages; }
 	UINT GetUnreadMessages() const { return m_uUnreadMessages; }
-	wstring GetSubject() const { return m_szSubject; }
-	const TStringVector & GetContacts() const { return m_vContacts; }
+	const wstring & GetSubject() const { return m_szSubject; }
+	const TInternedVector & GetContacts() const { return m_vContacts; }
 	const TWaveMessageVector & GetMessages() const { return m_vMessages; }
-	wstring GetEmailAddress() const { return m_szEmailAddress; }
+	const TFingerprintVector & GetFingerprints() const { return m_vFingerprints; }
+	BOOL HasFingerprint(ULONGLONG uFingerprint) const {
+		return binary_search(m_vFingerprints.begin(), m_vFingerprints.end(), uFingerprint);
+	}
+	const wstring & GetEmailAddress() const { return m_szEmailAddress; }
 	CDateTime GetTime() const { return m_dtTime; }
+	UINT GetTextLength() const { return m_uTextLength; }
+	void DiscardText();
 
 	static BOOL CreateDateTime(Json::Value & vRoot, CDateTime & dtResult) {
 		Json::Value & vMajor = vRoot[1];
@@ -436,7 +585,10 @@ public:
 private:
 	BOOL AddContacts(Json::Value & vRoot);
 	BOOL AddMessages(Json::Value & vRoot);
+	void UpdateFingerprints();
+	void CompactMessages();
 
+	friend class CWaveDecoder;
 };
 
 class CWaveCollection
@@ -485,6 +637,12 @@ class CWaveView
 private:
 	CWaveContactCollection * m_lpContacts;
 	CWaveCollection * m_lpWaves;
+	TStringBoolMap m_vChanges;
+	BOOL m_fAllChanged;
+	UINT m_uUnreadWaves;
+
+	static UINT m_uMostTextHeld;
+	static UINT m_uWavesOverBudget;
 
 public:
 	CWaveView();
@@ -494,35 +652,119 @@ public:
 
 	CWaveContactCollection * GetContacts() const { return m_lpContacts; }
 	CWaveCollection * GetWaves() const { return m_lpWaves; }
+	UINT GetUnreadWaves() const { return m_uUnreadWaves; }
+	BOOL GetAllChanged() const { return m_fAllChanged; }
+	const TStringBoolMap & GetChanges() const { return m_vChanges; }
+	void SetChanged(wstring szWaveID) { m_vChanges[szWaveID] = TRUE; }
+	void ClearChanges() {
+		m_vChanges.clear();
+		m_fAllChanged = FALSE;
+	}
+
+	static UINT GetMostTextHeld() { return m_uMostTextHeld; }
+	static UINT GetWavesOverBudget() { return m_uWavesOverBudget; }
 
 private:
 	void ProcessContacts(CWaveContactCollection * lpContacts);
 	void ProcessWaves(CWaveResponseStartListening * lpResponse);
 	void ProcessContactUpdates(CWaveContactStatusCollection * lpStatuses);
+	void EnforceTextBudget();
+
+	static bool CompareWaveTimes(CWave * lpLeft, CWave * lpRight) {
+		return lpLeft->GetTime() < lpRight->GetTime();
+	}
 };
 
+typedef enum
+{
+	WRS_LENGTH,
+	WRS_PAYLOAD,
+	WRS_MAX
+} WAVE_READER_STATE;
+
+typedef struct tagWAVE_TRACE_CHUNK
+{
+	DWORD dwTime;
+	DWORD cbData;
+} WAVE_TRACE_CHUNK, * LPWAVE_TRACE_CHUNK;
+
 class CWaveReader : public CCurlReader
 {
 private:
-	wstringstream m_szBuffer;
-	CUTF8Converter m_vConverter;
+	string m_szBuffer;
+	size_t m_nOffset;
+	size_t m_nScanned;
+	WAVE_READER_STATE m_nState;
+	size_t m_nPayloadOffset;
+	size_t m_nPayloadRemaining;
 	CWaveSession * m_lpSession;
+	CWaveTraceReplay * m_lpReplay;
+	BOOL m_fTrace;
+	HANDLE m_hTrace;
 
 public:
-	CWaveReader(CWaveSession * lpSession) {
+	CWaveReader(CWaveSession * lpSession, CWaveTraceReplay * lpReplay = NULL) {
 		ASSERT(lpSession != NULL);
 
 		m_lpSession = lpSession;
+		m_lpReplay = lpReplay;
+		m_nOffset = 0;
+		m_nScanned = 0;
+		m_nState = WRS_LENGTH;
+		m_nPayloadOffset = 0;
+		m_nPayloadRemaining = 0;
+		m_fTrace = lpReplay == NULL;
+		m_hTrace = INVALID_HANDLE_VALUE;
 	}
+	virtual ~CWaveReader();
+
 	BOOL Read(LPBYTE lpData, DWORD cbData);
-	
+
+	static LPCSTR SkipCharacters(LPCSTR szBegin, LPCSTR szEnd, size_t & nCharacters);
+
 private:
 	BOOL PumpResponseBuffer();
 	BOOL PumpMessage(BOOL & fSuccess);
+	BOOL ReadLength(BOOL & fSuccess);
+	BOOL ReadPayload(BOOL & fSuccess);
+	void CompactBuffer();
+	void TraceChunk(LPBYTE lpData, DWORD cbData);
+};
+
+class CWaveTraceReplay : private CThread
+{
+private:
+	CWaveSession * m_lpSession;
+	wstring m_szPath;
+	BOOL m_fRealTime;
+	BOOL m_fOffline;
+	BOOL m_fSuccess;
+	DWORD m_dwElapsed;
+	DWORD m_dwChunks;
+	DWORD m_dwBytes;
+	Json::Reader m_vReader;
+	CWaveDecoder * m_lpDecoder;
+
+public:
+	CWaveTraceReplay(CWaveSession * lpSession, wstring szPath, BOOL fRealTime);
+	virtual ~CWaveTraceReplay();
+
+	BOOL Wait();
+	DWORD GetElapsed() const { return m_dwElapsed; }
+	DWORD GetChunks() const { return m_dwChunks; }
+	DWORD GetBytes() const { return m_dwBytes; }
+	BOOL ParseChannelResponse(LPCSTR szBegin, LPCSTR szEnd);
+
+protected:
+	DWORD ThreadProc();
+
+private:
+	static BOOL ReadTrace(HANDLE hFile, LPVOID lpBuffer, DWORD cbBuffer);
 };
 
 #include "waverequest.h"
 #include "waveresponse.h"
+#include "wavedecoder.h"
 #include "unreadwave.h"
 
 #endif // _INC_WAVE
@@ -0,0 +1,207 @@
+/*
+ * This file is part of Google Wave Notifier.
+ *
+ * Google Wave Notifier is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Google Wave Notifier is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Google Wave Notifier.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _INC_WAVEDECODER
+#define _INC_WAVEDECODER
+
+#pragma once
+
+class CWaveChannelItem;
+
+typedef vector<CWaveChannelItem *> TWaveChannelItemVector;
+typedef TWaveChannelItemVector::iterator TWaveChannelItemVectorIter;
+typedef TWaveChannelItemVector::const_iterator TWaveChannelItemVectorConstIter;
+
+typedef enum
+{
+	WCIT_NOOP,
+	WCIT_SID,
+	WCIT_RESPONSE,
+	WCIT_MAX
+} WAVE_CHANNEL_ITEM_TYPE;
+
+typedef enum
+{
+	WDC_FRAME,
+	WDC_ITEM,
+	WDC_CONTENT,
+	WDC_RESPONSE,
+	WDC_PAYLOAD,
+	WDC_WAVES,
+	WDC_WAVE,
+	WDC_WAVE_CONTACTS,
+	WDC_WAVE_TIME,
+	WDC_WAVE_SUBJECT,
+	WDC_MESSAGES,
+	WDC_MESSAGE,
+	WDC_REMOVED_WAVES,
+	WDC_CONTACTS,
+	WDC_CONTACT,
+	WDC_CONTACT_DETAILS,
+	WDC_NAMES,
+	WDC_NAME,
+	WDC_NAME_DETAILS,
+	WDC_STATUSES,
+	WDC_STATUSES_EMPTY,
+	WDC_STATUS,
+	WDC_STATUS_CONTACT,
+	WDC_STATUS_DETAILS,
+	WDC_SKIP,
+	WDC_MAX
+} WAVE_DECODER_CONTEXT;
+
+typedef enum
+{
+	WDV_OBJECT,
+	WDV_ARRAY,
+	WDV_STRING,
+	WDV_INT,
+	WDV_BOOL,
+	WDV_NULL,
+	WDV_OTHER,
+	WDV_MAX
+} WAVE_DECODER_VALUE;
+
+typedef struct tagWAVE_DECODER_FRAME
+{
+	WAVE_DECODER_CONTEXT nContext;
+	wstring szKey;
+	UINT uIndex;
+	DWORD dwFields;
+	BOOL fInvalid;
+	LPVOID lpObject;
+	LPVOID lpChild;
+} WAVE_DECODER_FRAME, * LPWAVE_DECODER_FRAME;
+
+typedef vector<WAVE_DECODER_FRAME> TWaveDecoderFrameVector;
+typedef TWaveDecoderFrameVector::iterator TWaveDecoderFrameVectorIter;
+typedef TWaveDecoderFrameVector::const_iterator TWaveDecoderFrameVectorConstIter;
+
+typedef struct tagWAVE_DECODER_HASH
+{
+	ULONGLONG uHash;
+	CWave * lpWave;
+} WAVE_DECODER_HASH, * LPWAVE_DECODER_HASH;
+
+typedef map<wstring, WAVE_DECODER_HASH> TWaveDecoderHashMap;
+typedef TWaveDecoderHashMap::iterator TWaveDecoderHashMapIter;
+typedef TWaveDecoderHashMap::const_iterator TWaveDecoderHashMapConstIter;
+
+class CWaveChannelItem
+{
+private:
+	INT m_nAID;
+	WAVE_CHANNEL_ITEM_TYPE m_nType;
+	BOOL m_fSuccess;
+	wstring m_szSID;
+	CWaveResponse * m_lpResponse;
+
+public:
+	CWaveChannelItem() : m_nAID(0), m_nType(WCIT_NOOP), m_fSuccess(FALSE), m_lpResponse(NULL) { }
+	~CWaveChannelItem() { if (m_lpResponse != NULL) delete m_lpResponse; }
+
+	INT GetAID() const { return m_nAID; }
+	WAVE_CHANNEL_ITEM_TYPE GetType() const { return m_nType; }
+	BOOL GetSuccess() const { return m_fSuccess; }
+	wstring GetSID() const { return m_szSID; }
+	CWaveResponse * DetachResponse() {
+		CWaveResponse * lpResponse = m_lpResponse;
+		m_lpResponse = NULL;
+		return lpResponse;
+	}
+
+	friend class CWaveDecoder;
+};
+
+class CWaveDecoder : public Json::ReaderHandler
+{
+private:
+	TWaveDecoderFrameVector m_vFrames;
+	TWaveChannelItemVector m_vItems;
+	BOOL m_fIsFrame;
+	CWaveChannelItem * m_lpItem;
+
+	BOOL m_fHadType;
+	BOOL m_fHadPayload;
+	BOOL m_fResponseFailed;
+	WAVE_MESSAGE_TYPE m_nResponseType;
+	wstring m_szRequestID;
+	BOOL m_fFinal;
+	CWaveResponse * m_lpResponse;
+
+	Json::ValueArena m_vPayloadArena;
+	Json::ValueBuilder * m_lpPayloadBuilder;
+	INT m_nPayloadDepth;
+
+	UINT m_uTimeMinor;
+	UINT m_uTimeMajor;
+
+	BOOL m_fHashing;
+	ULONGLONG m_uHash;
+	TWaveDecoderHashMap m_vHashes;
+	volatile LONG m_lReusedWaves;
+	volatile LONG m_lDecodedWaves;
+
+public:
+	CWaveDecoder();
+	~CWaveDecoder();
+
+	void Reset();
+
+	BOOL IsFrame() const { return m_fIsFrame; }
+	const TWaveChannelItemVector & GetItems() const { return m_vItems; }
+	LONG GetReusedWaves() const { return m_lReusedWaves; }
+	LONG GetDecodedWaves() const { return m_lDecodedWaves; }
+
+	bool startObject();
+	bool objectKey(const std::wstring & key);
+	bool endObject();
+	bool startArray();
+	bool endArray();
+	bool stringValue(std::wstring & value);
+	bool intValue(Json::Value::Int value);
+	bool uintValue(Json::Value::UInt value);
+	bool doubleValue(double value);
+	bool boolValue(bool value);
+	bool nullValue();
+
+private:
+	void Enter(WAVE_DECODER_VALUE nValue);
+	void Leave();
+	void Scalar(WAVE_DECODER_VALUE nValue, UINT uValue, wstring * lpValue);
+	void NextValue();
+	void Hash(CHAR cType, LPCVOID lpData = NULL, size_t cbData = 0);
+
+	void PushFrame(WAVE_DECODER_CONTEXT nContext, LPVOID lpObject = NULL);
+	WAVE_DECODER_CONTEXT GetChildContext(WAVE_DECODER_FRAME & vParent, WAVE_DECODER_VALUE nValue);
+	WAVE_DECODER_CONTEXT GetPayloadContext(WAVE_DECODER_FRAME & vParent, WAVE_DECODER_VALUE nValue);
+	void AssignScalar(WAVE_DECODER_FRAME & vFrame, WAVE_DECODER_VALUE nValue, UINT uValue, wstring * lpValue);
+	void CompleteFrame(WAVE_DECODER_FRAME & vFrame, WAVE_DECODER_FRAME & vParent);
+	void CompleteResponse();
+	void CompletePayload();
+	BOOL CompleteContact(WAVE_DECODER_FRAME & vFrame);
+
+	void BeginPayload(WAVE_DECODER_VALUE nValue);
+	void EndPayload();
+	void FailResponse();
+	void InvalidateContact();
+	void DeleteFrameObject(WAVE_DECODER_FRAME & vFrame);
+	void ForgetWave(const wstring & szID);
+	void PruneWaves();
+};
+
+#endif // _INC_WAVEDECODER
@@ -37,6 +37,22 @@ public:
 
 	virtual void CreateRequest(Json::Value & vRoot) = 0;
 	virtual void RequestCompleted() { }
+
+	// Folds a later request of the queue into this one. Returns TRUE
+	// when nothing of the later request is left to post.
+
+	virtual BOOL Merge(CWaveRequest * lpRequest) { return FALSE; }
+
+	// Returns TRUE when this request undoes an earlier request of the
+	// queue, so neither has to be posted.
+
+	virtual BOOL Cancels(CWaveRequest * lpRequest) { return FALSE; }
+
+	// Returns TRUE when the request must not reach the server before
+	// the listener with the given ID has been started. It is not posted
+	// while a post that starts the listener is in flight.
+
+	virtual BOOL DependsOnListener(const wstring & szID) const { return FALSE; }
 };
 
 class CWaveRequestGetAllContacts : public CWaveRequest
@@ -45,6 +61,7 @@ public:
 	CWaveRequestGetAllContacts() : CWaveRequest(WMT_GET_ALL_CONTACTS) { }
 
 	void CreateRequest(Json::Value & vRoot);
+	BOOL Merge(CWaveRequest * lpRequest) { return lpRequest->GetType() == GetType(); }
 };
 
 class CWaveRequestStartListening : public CWaveRequest
@@ -58,6 +75,7 @@ public:
 		if (m_lpListener != NULL) delete m_lpListener;
 	}
 
+	wstring GetListenerID() const { return m_lpListener->GetID(); }
 	void CreateRequest(Json::Value & vRoot);
 	void RequestCompleted();
 };
@@ -76,6 +94,7 @@ public:
 		m_vEmailAddresses.push_back(szEmailAddress);
 	}
 	void CreateRequest(Json::Value & vRoot);
+	BOOL Merge(CWaveRequest * lpRequest);
 };
 
 class CWaveRequestStopListening : public CWaveRequest
@@ -92,6 +111,9 @@ public:
 
 	void CreateRequest(Json::Value & vRoot);
 	void RequestCompleted();
+	BOOL Merge(CWaveRequest * lpRequest);
+	BOOL Cancels(CWaveRequest * lpRequest);
+	BOOL DependsOnListener(const wstring & szID) const { return szID == m_szID; }
 };
 
 class CWaveRequestContactUpdates : public CWaveRequest
@@ -100,6 +122,7 @@ public:
 	CWaveRequestContactUpdates() : CWaveRequest(WMT_CONTACT_UPDATES) { }
 
 	void CreateRequest(Json::Value & vRoot);
+	BOOL Merge(CWaveRequest * lpRequest) { return lpRequest->GetType() == GetType(); }
 };
 
 #endif // _INC_WAVEREQUEST
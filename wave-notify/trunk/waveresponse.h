@@ -41,11 +41,15 @@ public:
 	BOOL GetIsFinal() const { return m_fIsFinal; }
 
 	static CWaveResponse * Parse(Json::Value & vRoot);
+	static CWaveResponse * Create(WAVE_MESSAGE_TYPE nType);
 
 protected:
 	virtual BOOL AssignJson(Json::Value & vRoot) = 0;
 
 	BOOL ReadStringArray(TStringVector & vStrings, Json::Value & vRoot);
+
+private:
+	friend class CWaveDecoder;
 };
 
 class CWaveResponseGetAllContacts : public CWaveResponse
@@ -72,6 +76,9 @@ protected:
 
 		return m_lpContacts != NULL;
 	}
+
+private:
+	friend class CWaveDecoder;
 };
 
 class  CWaveResponseStartListening : public CWaveResponse
@@ -90,10 +97,7 @@ public:
 
 	CWaveCollection * GetWaves() const { return m_lpWaves; }
 
-	void GetRemovedWaves(TStringVector & vRemovedWaves) const {
-		for (TStringVectorConstIter iter = m_vRemovedWaves.begin(); iter != m_vRemovedWaves.end(); iter++)
-			vRemovedWaves.push_back(*iter);
-	}
+	const TStringVector & GetRemovedWaves() const { return m_vRemovedWaves; }
 
 protected:
 	BOOL AssignJson(Json::Value & vRoot) {
@@ -107,6 +111,9 @@ protected:
 
 		return m_lpWaves != NULL;
 	}
+
+private:
+	friend class CWaveDecoder;
 };
 
 class CWaveResponseGetContactDetails : public CWaveResponse
@@ -133,6 +140,9 @@ protected:
 
 		return m_lpContacts != NULL;
 	}
+
+private:
+	friend class CWaveDecoder;
 };
 
 class CWaveResponseStopListening : public CWaveResponse
@@ -171,6 +181,9 @@ protected:
 
 		return m_lpStatuses != NULL;
 	}
+
+private:
+	friend class CWaveDecoder;
 };
 
 #endif // _INC_WAVERESPONSE